@@ -1,21 +1,30 @@
 #include "btvm.h"
 #include "vm/vm_functions.h"
 #include "btvm_types.h"
+#include "io/sliceio.h"
 #include "../bt_lexer.h"
 #include <iostream>
+#include <algorithm>
+#include <cctype>
 #include <cstdio>
 #include <cmath>
 
 #define ColorizeFail(s) "\x1b[31m" << s << "\x1b[0m"
 #define ColorizeOk(s)   "\x1b[32m" << s << "\x1b[0m"
 
+#define SEEK_PREFETCH_SIZE (128u * 1024u)
+#define FIND_CHUNK_SIZE    (64u * 1024u)
+#define MAX_NESTED_DEPTH   16 // RunTemplate() calls within RunTemplate() calls
+
 // Parser interface
 void* BTParserAlloc(void* (*mallocproc)(size_t));
 void BTParserFree(void* p, void (*freeproc)(void*));
 void BTParser(void* yyp, int yymajor, BTLexer::Token* yyminor, BTVM* btvm);
 
-BTVM::BTVM(BTVMIO *btvmio): VM(), _fgcolor(ColorInvalid), _bgcolor(ColorInvalid), _btvmio(btvmio)
+BTVM::BTVM(BTVMIO *btvmio): VM(), _tfindresults(NULL), _fgcolor(ColorInvalid), _bgcolor(ColorInvalid), _depth(0), _btvmio(btvmio)
 {
+    SymbolContext(&this->symbols);
+
     this->initTypes();
     this->initFunctions();
     this->initColors();
@@ -29,6 +38,12 @@ BTVM::~BTVM()
 
 void BTVM::parse(const string &code)
 {
+    SymbolContext(&this->symbols);
+    this->_btvmio->resetStats();
+    this->_btvmio->discardWrites(); // Left over by a failed run
+    this->_btvmio->resetHoles();
+    this->_nested.clear();
+    this->_nestedvms.clear();
     VM::parse(code);
 
     BTLexer lexer(code.c_str());
@@ -53,19 +68,41 @@ void BTVM::parse(const string &code)
 
 BTEntryList BTVM::createTemplate()
 {
+    MemoryContext(&this->memory);
     BTEntryList btfmt;
 
     if(this->state == VMState::NoState)
     {
         for(auto it = this->allocations.begin(); it != this->allocations.end(); it++)
             btfmt.push_back(this->createEntry(*it, NULL));
+
+        this->attachEntries(NULL, NULL, btfmt);
     }
     else
+    {
         this->allocations.clear();
+        this->_nested.clear();
+    }
 
     return btfmt;
 }
 
+BTVMIOStats BTVM::ioStats() const
+{
+    return this->_btvmio->stats();
+}
+
+void BTVM::freezeTemplate(const BTEntryList &btentries)
+{
+    for(auto it = btentries.begin(); it != btentries.end(); it++) // Values may now be released from any thread
+    {
+        if((*it)->value)
+            (*it)->value->freeze();
+
+        BTVM::freezeTemplate((*it)->children);
+    }
+}
+
 void BTVM::print(const string &s)
 {
     cout << s;
@@ -83,6 +120,31 @@ void BTVM::readValue(const VMValuePtr& vmvar, uint64_t size, bool seek)
     this->_btvmio->read(vmvar, size);
 }
 
+void BTVM::readValues(const VMValueMembers &vmvalues, uint64_t size)
+{
+    this->_btvmio->readArray(vmvalues, size);
+}
+
+void BTVM::prefetch(uint64_t size)
+{
+    this->_btvmio->prefetch(this->_btvmio->offset(), size);
+}
+
+void BTVM::writeValue(const VMValuePtr &vmvar, uint64_t size)
+{
+    if(!this->_btvmio->writable())
+        return; // Read only inputs, assignments stay in memory
+
+    if(!this->_btvmio->write(vmvar, size))
+        this->error("'" + this->symbolName(vmvar->value_id) + "': cannot write back to the input");
+}
+
+void BTVM::commitValues()
+{
+    if(!this->_btvmio->commit())
+        this->error("Cannot write to the input");
+}
+
 void BTVM::entryCreated(const BTEntryPtr &btentry)
 {
     VMUnused(btentry);
@@ -116,7 +178,7 @@ uint32_t BTVM::currentBgColor() const
 
 BTEntryPtr BTVM::createEntry(const VMValuePtr &vmvalue, const BTEntryPtr& btparent)
 {
-    BTEntryPtr btentry = std::make_shared<BTEntry>(vmvalue, this->_btvmio->endianness());
+    BTEntryPtr btentry = std::allocate_shared<BTEntry>(VMMemory::Allocator<BTEntry, VMMemoryCategory::Entries>(), vmvalue, this->_btvmio->endianness());
     btentry->location = BTLocation(vmvalue->value_offset, this->sizeOf(vmvalue));
     btentry->parent = btparent;
 
@@ -126,10 +188,64 @@ BTEntryPtr BTVM::createEntry(const VMValuePtr &vmvalue, const BTEntryPtr& btpare
             btentry->children.push_back(this->createEntry(*it, btentry));
     }
 
+    this->attachEntries(vmvalue.get(), btentry, btentry->children);
     this->entryCreated(btentry);
     return btentry;
 }
 
+void BTVM::attachEntries(const VMValue *vmparent, const BTEntryPtr &btparent, BTEntryList &btentries)
+{
+    auto it = this->_nested.find(vmparent);
+
+    if(it == this->_nested.end())
+        return;
+
+    std::function<void(const BTEntryPtr&)> notify = [&](const BTEntryPtr& btentry) { // Children first, like createEntry()
+        for(const BTEntryPtr& btchild : btentry->children)
+            notify(btchild);
+
+        this->entryCreated(btentry);
+    };
+
+    for(const BTEntryPtr& btentry : it->second.second)
+    {
+        BTEntryPtr btclone = BTVM::cloneEntry(btentry, btparent); // Every createTemplate() gets its own tree
+        notify(btclone);
+        btentries.push_back(btclone);
+    }
+}
+
+BTEntryPtr BTVM::cloneEntry(const BTEntryPtr &btentry, const BTEntryPtr &btparent)
+{
+    BTEntryPtr btclone = std::allocate_shared<BTEntry>(VMMemory::Allocator<BTEntry, VMMemoryCategory::Entries>(), *btentry);
+    btclone->parent = btparent;
+    btclone->children.clear();
+
+    for(const BTEntryPtr& btchild : btentry->children)
+        btclone->children.push_back(BTVM::cloneEntry(btchild, btclone));
+
+    return btclone;
+}
+
+void BTVM::importEntries(const BTVM &btvm, const BTEntryList &btentries, uint64_t offset)
+{
+    for(const BTEntryPtr& btentry : btentries) // Symbols and offsets of 'btvm' become ours
+    {
+        btentry->name = this->symbols.intern(btvm.symbolName(btentry->name));
+        btentry->location.offset += offset;
+
+        if(btentry->value)
+        {
+            btentry->value->value_id = btentry->name;
+
+            if(btentry->value->value_typeid != SymbolNone)
+                btentry->value->value_typeid = this->symbols.intern(btvm.symbolName(btentry->value->value_typeid));
+        }
+
+        this->importEntries(btvm, btentry->children, offset);
+    }
+}
+
 VMValuePtr BTVM::readScalar(NCall *ncall, uint64_t bits, bool issigned)
 {
     VMValuePtr pos;
@@ -137,6 +253,7 @@ VMValuePtr BTVM::readScalar(NCall *ncall, uint64_t bits, bool issigned)
     if(ncall->arguments.size() > 1)
         return this->error("Expected 0 or 1 arguments, " + std::to_string(ncall->arguments.size()) + " given");
 
+    uint64_t offset = this->_btvmio->offset();
     IO_NoSeek(this->_btvmio);
 
     if(ncall->arguments.size() == 1)
@@ -146,19 +263,73 @@ VMValuePtr BTVM::readScalar(NCall *ncall, uint64_t bits, bool issigned)
         if(!pos->is_scalar())
             return this->typeError(pos, "scalar");
 
+        if(!this->seekable(ncall, pos->ui_value))
+            return VMValuePtr();
+
         this->_btvmio->seek(pos->ui_value);
     }
 
     VMValuePtr vmvalue = VMValue::allocate(bits, issigned, false);
     this->_btvmio->read(vmvalue, this->sizeOf(vmvalue));
+
+    if(!this->seekable(ncall, offset)) // Looked too far ahead to come back
+        return VMValuePtr();
+
     return vmvalue;
 }
 
+bool BTVM::seekable(NCall *ncall, uint64_t offset)
+{
+    if(this->_btvmio->seekable(offset))
+        return true;
+
+    this->error(ncall->name->value + "(): offset " + std::to_string(offset) + " is outside of the input's rewind window");
+    return false;
+}
+
+void BTVM::findAll(const std::string &data, uint64_t start, uint64_t end, bool matchcase, std::vector<uint64_t> &results)
+{
+    uint64_t len = data.size(), next = start, pos = start;
+    bool skipholes = data.find_first_not_of('\0') != std::string::npos; // Zeros can match inside holes
+    std::vector<uint8_t> buffer(std::max<uint64_t>(FIND_CHUNK_SIZE, len * 2));
+
+    auto equals = [matchcase](uint8_t a, char b) {
+        uint8_t c = static_cast<uint8_t>(b);
+        return matchcase ? (a == c) : (std::tolower(a) == std::tolower(c));
+    };
+
+    while(pos + len <= end)
+    {
+        uint64_t regionend;
+
+        if(skipholes && this->_btvmio->holeAt(pos, regionend) && (regionend - pos >= len))
+        {
+            pos = regionend - (len - 1); // Only matches crossing the end of the hole are possible
+            continue;
+        }
+
+        uint64_t size = std::min<uint64_t>(buffer.size(), end - pos);
+        uint64_t count = this->_btvmio->readAt(pos, buffer.data(), size);
+        const uint8_t* last = buffer.data() + count;
+
+        for(const uint8_t* it = buffer.data() + ((next > pos) ? (next - pos) : 0); (it = std::search(it, last, data.begin(), data.end(), equals)) != last; it += len)
+        {
+            results.push_back(pos + (it - buffer.data()));
+            next = results.back() + len; // Matches don't overlap
+        }
+
+        if((count < size) || (pos + count >= end))
+            break;
+
+        pos += count - (len - 1); // Matches can cross chunks
+    }
+}
+
 void BTVM::initTypes()
 {
-    Node* n = BTVMTypes::buildTFindResults();
-    this->_builtin.push_back(n);
-    this->declare(n);
+    this->_tfindresults = BTVMTypes::buildTFindResults();
+    this->_builtin.push_back(this->_tfindresults);
+    this->declare(this->_tfindresults);
 }
 
 void BTVM::initFunctions()
@@ -187,6 +358,10 @@ void BTVM::initFunctions()
     this->functions["ReadUShort"]    = &BTVM::vmReadUShort;
     this->functions["LittleEndian"]  = &BTVM::vmLittleEndian;
     this->functions["BigEndian"]     = &BTVM::vmBigEndian;
+    this->functions["BitfieldDisablePadding"] = &BTVM::vmBitfieldDisablePadding;
+    this->functions["BitfieldEnablePadding"]  = &BTVM::vmBitfieldEnablePadding;
+    this->functions["BitfieldLeftToRight"]    = &BTVM::vmBitfieldLeftToRight;
+    this->functions["BitfieldRightToLeft"]    = &BTVM::vmBitfieldRightToLeft;
 
     // String Functions: https://www.sweetscape.com/010editor/manual/FuncString.htm
     this->functions["Strlen"]        = &BTVM::vmStrlen;
@@ -198,6 +373,7 @@ void BTVM::initFunctions()
     this->functions["FindAll"]       = &BTVM::vmFindAll;
 
     // Non-Standard Functions
+    this->functions["RunTemplate"]   = &BTVM::vmRunTemplate; // Applies a template to [start, start + size), its entries become children of the current struct
     this->functions["__btvm_test__"] = &BTVM::vmBtvmTest; // Non-standard BTVM function for unit testing
 }
 
@@ -241,7 +417,10 @@ VMValuePtr BTVM::vmPrintf(VM *self, NCall *ncall)
             args.push_back(self->interpret(*it));
     }
 
-    static_cast<BTVM*>(self)->print(VMFunctions::format_string(format, args));
+    BTVM* btvm = static_cast<BTVM*>(self);
+    btvm->_printbuffer.clear(); // Keeps its capacity between calls
+    VMFunctions::format_string(btvm->_printbuffer, format, args);
+    btvm->print(btvm->_printbuffer);
     return VMValuePtr();
 }
 
@@ -289,6 +468,42 @@ VMValuePtr BTVM::vmBigEndian(VM *self, NCall *ncall)
     return VMValuePtr();
 }
 
+VMValuePtr BTVM::vmBitfieldDisablePadding(VM *self, NCall *ncall)
+{
+    if(ncall->arguments.size() != 0)
+        return self->argumentError(ncall, 0);
+
+    static_cast<BTVM*>(self)->_btvmio->setBitfieldPadding(false);
+    return VMValuePtr();
+}
+
+VMValuePtr BTVM::vmBitfieldEnablePadding(VM *self, NCall *ncall)
+{
+    if(ncall->arguments.size() != 0)
+        return self->argumentError(ncall, 0);
+
+    static_cast<BTVM*>(self)->_btvmio->setBitfieldPadding(true);
+    return VMValuePtr();
+}
+
+VMValuePtr BTVM::vmBitfieldLeftToRight(VM *self, NCall *ncall)
+{
+    if(ncall->arguments.size() != 0)
+        return self->argumentError(ncall, 0);
+
+    static_cast<BTVM*>(self)->_btvmio->setBitfieldLeftToRight();
+    return VMValuePtr();
+}
+
+VMValuePtr BTVM::vmBitfieldRightToLeft(VM *self, NCall *ncall)
+{
+    if(ncall->arguments.size() != 0)
+        return self->argumentError(ncall, 0);
+
+    static_cast<BTVM*>(self)->_btvmio->setBitfieldRightToLeft();
+    return VMValuePtr();
+}
+
 VMValuePtr BTVM::vmFSeek(VM *self, NCall *ncall)
 {
     if(ncall->arguments.size() != 1)
@@ -302,10 +517,14 @@ VMValuePtr BTVM::vmFSeek(VM *self, NCall *ncall)
     BTVM* btvm = static_cast<BTVM*>(self);
     uint64_t offset = *vmvalue->value_ref<uint64_t>();
 
+    if(!btvm->seekable(ncall, offset))
+        return VMValuePtr();
+
     if(offset >= btvm->_btvmio->size())
         return VMValue::allocate_literal(static_cast<int64_t>(-1));
 
     btvm->_btvmio->seek(offset);
+    btvm->_btvmio->prefetch(offset, SEEK_PREFETCH_SIZE); // Templates usually read a header there
     return VMValue::allocate_literal(static_cast<int64_t>(0));
 }
 
@@ -338,11 +557,57 @@ VMValuePtr BTVM::vmCeil(VM *self, NCall *ncall)
 
 VMValuePtr BTVM::vmFindAll(VM *self, NCall *ncall)
 {
-    VMUnused(self);
-    VMUnused(ncall);
+    if((ncall->arguments.size() < 1) || (ncall->arguments.size() > 9))
+        return self->error("Expected 1 to 9 arguments, " + std::to_string(ncall->arguments.size()) + " given");
 
-    cout << "FindAll(): Not implemented";
-    return VMValuePtr();
+    BTVM* btvm = static_cast<BTVM*>(self);
+    std::vector<VMValuePtr> args;
+
+    for(Node* narg : ncall->arguments)
+    {
+        args.push_back(self->interpret(narg));
+
+        if((args.size() > 1) && !args.back()->is_scalar())
+            return self->typeError(args.back(), "scalar");
+    }
+
+    if(!args[0]->is_string() || !args[0]->length())
+        return self->typeError(args[0], "non empty string");
+
+    // Arguments: data, matchcase, wholeword, method, tolerance, dir, start, size, wildcardMatchLength
+    bool matchcase = (args.size() <= 1) || *args[1];
+
+    if(((args.size() > 2) && *args[2]) || ((args.size() > 3) && args[3]->ui_value))
+        return self->error("FindAll(): only plain searches are supported");
+
+    uint64_t filesize = btvm->_btvmio->size();
+    uint64_t start = std::min(filesize, (args.size() > 6) ? args[6]->ui_value : 0);
+    uint64_t size = (args.size() > 7) ? args[7]->ui_value : 0;
+    uint64_t end = (size && (size < filesize - start)) ? (start + size) : filesize;
+    std::vector<uint64_t> offsets;
+
+    btvm->findAll(std::string(args[0]->value_ref<char>(), args[0]->length()), start, end, matchcase, offsets);
+
+    VMValuePtr vmresults = VMValue::allocate(VMValueType::Struct, btvm->_tfindresults);
+    VMValuePtr vmcount = VMValue::allocate(btvm->symbols.intern("count"));
+    VMValuePtr vmstart = VMValue::allocate(btvm->symbols.intern("start"));
+    VMValuePtr vmsize = VMValue::allocate(btvm->symbols.intern("size"));
+
+    vmcount->allocate_scalar(64, false, false);
+    vmcount->ui_value = offsets.size();
+    vmstart->allocate_array(offsets.size(), NULL);
+    vmsize->allocate_array(offsets.size(), NULL);
+
+    for(uint64_t offset : offsets)
+    {
+        vmstart->m_value.push_back(VMValue::allocate_literal(offset));
+        vmsize->m_value.push_back(VMValue::allocate_literal(static_cast<uint64_t>(args[0]->length())));
+    }
+
+    vmresults->m_value.push_back(vmcount);
+    vmresults->m_value.push_back(vmstart);
+    vmresults->m_value.push_back(vmsize);
+    return vmresults;
 }
 
 VMValuePtr BTVM::vmWarning(VM *self, NCall *ncall)
@@ -351,6 +616,62 @@ VMValuePtr BTVM::vmWarning(VM *self, NCall *ncall)
     return BTVM::vmPrintf(self, ncall);
 }
 
+VMValuePtr BTVM::vmRunTemplate(VM *self, NCall *ncall)
+{
+    if(ncall->arguments.size() != 3)
+        return self->argumentError(ncall, 3);
+
+    BTVM* btvm = static_cast<BTVM*>(self);
+    VMValuePtr vmfile = self->interpret(ncall->arguments[0]);
+
+    if(!vmfile->is_string())
+        return self->typeError(vmfile, "string");
+
+    VMValuePtr vmstart = self->interpret(ncall->arguments[1]);
+
+    if(!vmstart->is_scalar())
+        return self->typeError(vmstart, "scalar");
+
+    VMValuePtr vmsize = self->interpret(ncall->arguments[2]);
+
+    if(!vmsize->is_scalar())
+        return self->typeError(vmsize, "scalar");
+
+    std::string file = vmfile->value_ref<char>();
+
+    if(vmstart->ui_value > btvm->_btvmio->size())
+        return self->error("RunTemplate(): offset " + std::to_string(vmstart->ui_value) + " is outside of the input");
+
+    if(btvm->_depth >= MAX_NESTED_DEPTH) // Templates running themselves
+        return self->error("RunTemplate(): more than " + std::to_string(MAX_NESTED_DEPTH) + " nested templates");
+
+    std::unique_ptr<BTVMIO> sliceio(new SliceIO(btvm->_btvmio, vmstart->ui_value, vmsize->ui_value));
+    std::unique_ptr<BTVM> btvmnested(new BTVM(sliceio.get()));
+    btvmnested->_depth = btvm->_depth + 1;
+
+    try
+    {
+        btvmnested->execute(file);
+    }
+    catch(const std::runtime_error& e)
+    {
+        return self->error("RunTemplate(): " + std::string(e.what()));
+    }
+
+    if(btvmnested->state == VMState::Error)
+        return self->error("RunTemplate(): '" + file + "' failed");
+
+    BTEntryList btentries = btvmnested->createTemplate();
+    btvm->importEntries(*btvmnested, btentries, vmstart->ui_value);
+    btvm->_nestedvms.emplace_back(std::move(sliceio), std::move(btvmnested));
+
+    VMValuePtr vmparent = btvm->currentDeclaration();
+    auto& nested = btvm->_nested[vmparent.get()];
+    nested.first = vmparent; // Keeps the key alive
+    nested.second.insert(nested.second.end(), btentries.begin(), btentries.end());
+    return VMValue::allocate_literal(static_cast<int64_t>(btentries.size()));
+}
+
 VMValuePtr BTVM::vmBtvmTest(VM *self, NCall *ncall)
 {
     if(ncall->arguments.size() != 1)
@@ -414,10 +735,15 @@ VMValuePtr BTVM::vmReadBytes(VM *self, NCall *ncall)
     if(!vmn->is_scalar())
         return self->typeError(vmn, "scalar");
 
+    uint64_t offset = btvm->_btvmio->offset();
     IO_NoSeek(btvm->_btvmio);
 
+    if(!btvm->seekable(ncall, vmpos->ui_value))
+        return VMValuePtr();
+
     btvm->_btvmio->seek(vmpos->ui_value);
     btvm->_btvmio->read(vmbuffer, vmn->ui_value);
+    btvm->seekable(ncall, offset);
     return VMValuePtr();
 }
 
@@ -444,11 +770,19 @@ VMValuePtr BTVM::vmReadString(VM *self, NCall *ncall)
         maxlen = *vmmaxlen->value_ref<int32_t>();
     }
 
+    uint64_t offset = btvm->_btvmio->offset();
     IO_NoSeek(btvm->_btvmio);
 
+    if(!btvm->seekable(ncall, vmpos->ui_value))
+        return VMValuePtr();
+
     VMValuePtr vmvalue = VMValue::allocate(VMValueType::String);
     btvm->_btvmio->seek(vmpos->ui_value);
     btvm->_btvmio->readString(vmvalue, maxlen);
+
+    if(!btvm->seekable(ncall, offset))
+        return VMValuePtr();
+
     return vmvalue;
 }
 
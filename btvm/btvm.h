@@ -3,6 +3,8 @@
 
 #include <unordered_map>
 #include <string>
+#include <vector>
+#include <memory>
 #include <stack>
 #include "vm/vm.h"
 #include "format/btentry.h"
@@ -12,6 +14,7 @@ class BTVM: public VM
 {
     private:
         typedef std::unordered_map<uint64_t, uint32_t> ColorMap;
+        typedef std::unordered_map<const VMValue*, std::pair<VMValuePtr, BTEntryList> > NestedMap; // Entries of nested templates, by parent value (NULL at top level)
 
     public:
         BTVM(BTVMIO* btvmio);
@@ -19,10 +22,16 @@ class BTVM: public VM
         virtual void parse(const std::string& code);
         virtual uint32_t color(const std::string& color) const;
         BTEntryList createTemplate();
+        BTVMIOStats ioStats() const; // Counters of the last run
+        static void freezeTemplate(const BTEntryList& btentries);
 
     protected:
         virtual void print(const std::string& s);
         virtual void readValue(const VMValuePtr &vmvar, uint64_t size, bool seek);
+        virtual void readValues(const VMValueMembers& vmvalues, uint64_t size);
+        virtual void prefetch(uint64_t size);
+        virtual void writeValue(const VMValuePtr& vmvar, uint64_t size);
+        virtual void commitValues();
         virtual void entryCreated(const BTEntryPtr& btentry);
         virtual uint64_t currentOffset() const;
         virtual uint32_t currentFgColor() const;
@@ -30,7 +39,12 @@ class BTVM: public VM
 
     private:
         BTEntryPtr createEntry(const VMValuePtr& vmvalue, const BTEntryPtr &btparent);
+        void attachEntries(const VMValue* vmparent, const BTEntryPtr& btparent, BTEntryList& btentries);
+        void importEntries(const BTVM& btvm, const BTEntryList& btentries, uint64_t offset);
+        static BTEntryPtr cloneEntry(const BTEntryPtr& btentry, const BTEntryPtr& btparent);
         VMValuePtr readScalar(NCall* ncall, uint64_t bits, bool issigned);
+        bool seekable(NCall* ncall, uint64_t offset);
+        void findAll(const std::string& data, uint64_t start, uint64_t end, bool matchcase, std::vector<uint64_t>& results);
         void initTypes();
         void initFunctions();
         void initColors();
@@ -57,6 +71,10 @@ class BTVM: public VM
         static VMValuePtr vmReadUShort(VM *self, NCall* ncall);
         static VMValuePtr vmLittleEndian(VM *self, NCall* ncall);
         static VMValuePtr vmBigEndian(VM *self, NCall* ncall);
+        static VMValuePtr vmBitfieldDisablePadding(VM *self, NCall* ncall);
+        static VMValuePtr vmBitfieldEnablePadding(VM *self, NCall* ncall);
+        static VMValuePtr vmBitfieldLeftToRight(VM *self, NCall* ncall);
+        static VMValuePtr vmBitfieldRightToLeft(VM *self, NCall* ncall);
         static VMValuePtr vmFSeek(VM *self, NCall* ncall);
 
     private: // String Functions
@@ -69,13 +87,19 @@ class BTVM: public VM
         static VMValuePtr vmFindAll(VM* self, NCall* ncall);
 
     private: // Non-Standard Functions
+        static VMValuePtr vmRunTemplate(VM *self, NCall* ncall);
         static VMValuePtr vmBtvmTest(VM *self, NCall* ncall);
 
     private:
         std::unordered_map<std::string, uint32_t> _colors;
+        std::string _printbuffer;
         std::list<Node*> _builtin;
+        NestedMap _nested;
+        std::list<std::pair<std::unique_ptr<BTVMIO>, std::unique_ptr<BTVM> > > _nestedvms; // Their values point to their ASTs
+        Node* _tfindresults;
         uint32_t _fgcolor;
         uint32_t _bgcolor;
+        uint32_t _depth; // Nesting level of RunTemplate() calls
         BTVMIO* _btvmio;
 };
 
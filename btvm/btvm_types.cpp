@@ -23,9 +23,8 @@ static NScalarType* buildScalar(const std::string& name, uint64_t bits, bool iss
 
 static NVariable* buildVariable(const std::string& name, Node* ntype, Node* nsize = NULL)
 {
-    NVariable* nvar = new NVariable(identifier(name));
+    NVariable* nvar = new NVariable(identifier(name), nsize);
     nvar->type = ntype;
-    nvar->size = nsize;
     return nvar;
 }
 
@@ -38,9 +37,9 @@ static NStruct* buildStruct(const std::string& name, const NodeList& members) {
 Node *BTVMTypes::buildTFindResults()
 {
     NodeList members;
-    members.push_back(buildVariable("count", buildScalar("uint64", 32, false)));
-    members.push_back(buildVariable("start", buildScalar("uint64", 32, false), empty_block()));
-    members.push_back(buildVariable("size", buildScalar("uint64", 32, false), empty_block()));
+    members.push_back(buildVariable("count", buildScalar("uint64", 64, false)));
+    members.push_back(buildVariable("start", buildScalar("uint64", 64, false), empty_block()));
+    members.push_back(buildVariable("size", buildScalar("uint64", 64, false), empty_block()));
 
     return buildStruct("TFindResults", members);
 }
@@ -1,23 +1,110 @@
 #include "btvmio.h"
 #include "vm/ast.h"
+#include <algorithm>
 #include <cstring>
-
-#define BUFFER_SIZE 4096
-#define align_to(x, a) (x + (a - (x % a)))
+#include <chrono>
+#include <unistd.h>
+#include <cerrno>
+
+#define DEFAULT_BLOCK_SIZE 4096
+#define ARRAY_CHUNK_SIZE   4096
+#define PREFETCH_MIN_SIZE  (64u * 1024u) // Smaller extents are served by the window anyway
+#define PREFETCH_MAX_SIZE  (16u * 1024u * 1024u)
 #define is_bigendian() (*reinterpret_cast<const char*>(&BTVMIO::PLATFORM_ENDIANNESS) == 0)
 
 const int BTVMIO::PLATFORM_ENDIANNESS = 1;
 
-BTVMIO::BTVMIO(): _buffersize(0)
+typedef void (*ScalarLoader)(uint8_t* data);
+
+template<typename T, bool swap> static void loadScalar(uint8_t* data) // Widens the value read in 'data' to 64 bits
+{
+    typename std::make_unsigned<T>::type u;
+    std::memcpy(&u, data, sizeof(T));
+
+    if(swap)
+        u = VMFunctions::byte_swap(u);
+
+    uint64_t value = static_cast<uint64_t>(static_cast<T>(u)); // Signed types are sign extended
+    std::memcpy(data, &value, sizeof(uint64_t));
+}
+
+template<bool swap> static void loadFloat(uint8_t* data) // Floats are held as doubles
+{
+    uint32_t u;
+    float f;
+    std::memcpy(&u, data, sizeof(uint32_t));
+
+    if(swap)
+        u = VMFunctions::byte_swap(u);
+
+    std::memcpy(&f, &u, sizeof(float));
+
+    double d = static_cast<double>(f);
+    std::memcpy(data, &d, sizeof(double));
+}
+
+#define SCALAR_LOADER_ROW(swap) { NULL, NULL, NULL, NULL, NULL, NULL, /* Null ... String */ \
+                               NULL, /* Bool */ \
+                               NULL, &loadScalar<uint16_t, swap>, &loadScalar<uint32_t, swap>, &loadScalar<uint64_t, swap>, \
+                               NULL, &loadScalar<int16_t, swap>, &loadScalar<int32_t, swap>, &loadScalar<int64_t, swap>, \
+                               &loadFloat<swap>, &loadScalar<int64_t, swap> }
+
+static const ScalarLoader SCALAR_LOADERS[2][VMValueType::Double + 1] = { SCALAR_LOADER_ROW(false), SCALAR_LOADER_ROW(true) }; // Indexed by [swap][value_type]
+
+typedef void (*ScalarStorer)(const uint8_t* data, uint8_t* out);
+
+template<typename T, bool swap> static void storeScalar(const uint8_t* data, uint8_t* out) // Inverse of loadScalar()
+{
+    uint64_t value;
+    std::memcpy(&value, data, sizeof(uint64_t));
+
+    T u = static_cast<T>(value);
+
+    if(swap)
+        u = VMFunctions::byte_swap(u);
+
+    std::memcpy(out, &u, sizeof(T));
+}
+
+template<bool swap> static void storeFloat(const uint8_t* data, uint8_t* out) // Inverse of loadFloat()
+{
+    double d;
+    std::memcpy(&d, data, sizeof(double));
+
+    float f = static_cast<float>(d);
+    uint32_t u;
+    std::memcpy(&u, &f, sizeof(float));
+
+    if(swap)
+        u = VMFunctions::byte_swap(u);
+
+    std::memcpy(out, &u, sizeof(uint32_t));
+}
+
+#define SCALAR_STORER_ROW(swap) { NULL, NULL, NULL, NULL, NULL, NULL, /* Null ... String */ \
+                               NULL, /* Bool */ \
+                               NULL, &storeScalar<uint16_t, swap>, &storeScalar<uint32_t, swap>, &storeScalar<uint64_t, swap>, \
+                               NULL, &storeScalar<uint16_t, swap>, &storeScalar<uint32_t, swap>, &storeScalar<uint64_t, swap>, \
+                               &storeFloat<swap>, &storeScalar<uint64_t, swap> }
+
+static const ScalarStorer SCALAR_STORERS[2][VMValueType::Double + 1] = { SCALAR_STORER_ROW(false), SCALAR_STORER_ROW(true) }; // Indexed by [swap][value_type]
+
+BTVMIO::BTVMIO(): _bitfieldorder(BitfieldDefault), _bitfieldpadding(true), _window(NULL), _windowoffset(0), _windowsize(0), _windowlast(false), _readahead(NULL), _readaheaddepth(0), _trace(NULL), _regionstart(0), _regionend(0), _regionhole(false)
 {
     this->_platformendianness = this->_endianness = is_bigendian() ? BTEndianness::BigEndian : BTEndianness::LittleEndian;
-    this->_buffer = static_cast<uint8_t*>(malloc(BUFFER_SIZE));
+    this->_cache = new BlockCache(1, DEFAULT_BLOCK_SIZE);
 }
 
 BTVMIO::~BTVMIO()
 {
-    free(this->_buffer);
-    this->_buffer = NULL;
+    delete this->_trace;
+    this->_trace = NULL;
+
+    delete this->_readahead;
+    this->_readahead = NULL;
+
+    delete this->_cache;
+    this->_cache = NULL;
 }
 
 void BTVMIO::read(const VMValuePtr &vmvalue, uint64_t bytes)
@@ -29,38 +116,101 @@ void BTVMIO::read(const VMValuePtr &vmvalue, uint64_t bytes)
     }
 
     if(vmvalue->value_bits != -1)
-    {
-        uint64_t bits = vmvalue->value_bits == -1 ? (bytes * PLATFORM_BITS) : static_cast<uint64_t>(vmvalue->value_bits);
-        this->_cursor.size = bytes;
-        this->readBits(vmvalue->value_ref<uint8_t>(), bits);
-    }
+        this->readBits(vmvalue, static_cast<uint64_t>(vmvalue->value_bits), bytes);
     else
     {
+        uint8_t* data = vmvalue->value_ref<uint8_t>();
+        ScalarLoader loader = SCALAR_LOADERS[this->swapsBytes()][vmvalue->value_type];
+
         this->alignCursor();
-        this->readBytes(vmvalue->value_ref<uint8_t>(), bytes);
-        this->elaborateEndianness(vmvalue);
+        vmvalue->value_offset = this->_cursor.position;
+        vmvalue->value_flags |= VMValueFlags::Input | (this->swapsBytes() ? VMValueFlags::Swapped : VMValueFlags::None);
+        this->readBytes(data, bytes);
+
+        if(loader)
+            loader(data);
+    }
+}
+
+void BTVMIO::readArray(const VMValueMembers &vmvalues, uint64_t bytes)
+{
+    if(!vmvalues.size())
+        return;
+
+    ScalarLoader loader = SCALAR_LOADERS[false][vmvalues.front()->value_type]; // Swapped in bulk below
+    bool swap = this->swapsBytes() && (bytes > 1);
+    uint64_t step = ARRAY_CHUNK_SIZE / bytes;
+    uint8_t chunk[ARRAY_CHUNK_SIZE];
+
+    this->alignCursor();
+    uint64_t offset = this->_cursor.position;
+
+    for(size_t i = 0; i < vmvalues.size(); )
+    {
+        uint64_t count = std::min<uint64_t>(step, vmvalues.size() - i), chunksize = count * bytes;
+        uint64_t datasize = this->readBytes(chunk, chunksize);
+        std::memset(chunk + datasize, 0, chunksize - datasize); // Values past EOF are zero, as if read one by one
+
+        if(swap)
+            VMFunctions::swap_bytes(chunk, count, bytes);
+
+        for(const uint8_t* p = chunk; count--; p += bytes, i++)
+        {
+            uint8_t* data = vmvalues[i]->value_ref<uint8_t>();
+            std::memcpy(data, p, bytes);
+            vmvalues[i]->value_offset = offset + (i * bytes);
+            vmvalues[i]->value_flags |= VMValueFlags::Input | (swap ? VMValueFlags::Swapped : VMValueFlags::None);
+
+            if(loader)
+                loader(data);
+        }
     }
 }
 
 void BTVMIO::readString(const VMValuePtr &vmvalue, int64_t maxlen)
 {
-    uint8_t* sbuffer = this->_buffer + this->_cursor.rel_position;
     this->alignCursor();
+    uint64_t start = this->_cursor.position;
+    vmvalue->value_offset = start;
+    vmvalue->value_flags |= VMValueFlags::Input;
 
-    while(!this->atEof() && maxlen)
+    while(maxlen && !this->atDataEnd())
     {
         if(this->atBufferEnd())
-            sbuffer = this->updateBuffer();
+        {
+            this->updateBuffer();
+            continue;
+        }
 
-        vmvalue->s_value.push_back(*sbuffer);
+        const uint8_t* sbuffer = this->_window + this->_cursor.rel_position;
+        uint64_t span = this->_windowsize - this->_cursor.rel_position;
 
-        if((maxlen == -1) && (*sbuffer == '\0'))
-            break;
-        else if(maxlen > 0)
-            maxlen--;
+        if(maxlen > 0)
+        {
+            span = std::min(span, static_cast<uint64_t>(maxlen));
+            maxlen -= span;
+        }
+        else
+        {
+            const char* sbegin = reinterpret_cast<const char*>(sbuffer);
+            const uint8_t* nul = sbuffer + (VMFunctions::find_terminator(sbegin, sbegin + span) - sbegin);
+
+            if(nul < sbuffer + span)
+            {
+                vmvalue->s_value.append(sbuffer, nul + 1);
+                this->_cursor.advance(nul - sbuffer); // Stop on the terminator
+                this->_stats.delivered_bytes += (nul - sbuffer) + 1;
+                break;
+            }
+        }
 
-        sbuffer++; this->_cursor++;
+        vmvalue->s_value.append(sbuffer, sbuffer + span);
+        this->_cursor.advance(span);
+        this->_stats.delivered_bytes += span;
     }
+
+    if(this->_trace)
+        this->_trace->record(AccessTrace::Read, start, this->_cursor.position - start);
 }
 
 void BTVMIO::walk(uint64_t steps)
@@ -72,21 +222,216 @@ void BTVMIO::walk(uint64_t steps)
     this->seek(this->_cursor.position + steps);
 }
 
+uint64_t BTVMIO::readAt(uint64_t offset, uint8_t *buffer, uint64_t size)
+{
+    if(this->_trace)
+        this->_trace->record(AccessTrace::Raw, offset, size);
+
+    return this->fetchData(offset, buffer, size);
+}
+
+const uint8_t *BTVMIO::mapAt(uint64_t offset, uint64_t &size)
+{
+    return this->mapRange(offset, size, true);
+}
+
+const uint8_t *BTVMIO::mapRange(uint64_t offset, uint64_t &size, bool pin)
+{
+    uint64_t nextwrite = this->_journal.nextWrite(offset);
+
+    if(nextwrite <= offset)
+        return NULL; // Pending data is merged by fetchData()
+
+    const uint8_t* data = this->mapData(offset, size, pin);
+
+    if(data && (nextwrite != UINT64_MAX))
+        size = std::min(size, nextwrite - offset);
+
+    return data;
+}
+
+void BTVMIO::prefetch(uint64_t offset, uint64_t size)
+{
+    if((offset >= this->size()) || (size < PREFETCH_MIN_SIZE))
+        return;
+
+    this->prefetchData(offset, std::min<uint64_t>(std::min<uint64_t>(size, PREFETCH_MAX_SIZE), this->size() - offset));
+}
+
+bool BTVMIO::holeAt(uint64_t offset, uint64_t &end)
+{
+    std::lock_guard<std::mutex> lock(this->_iomutex);
+    return this->regionAt(offset, end);
+}
+
+void BTVMIO::resetHoles()
+{
+    std::lock_guard<std::mutex> lock(this->_iomutex);
+    this->dropRegion();
+}
+
+bool BTVMIO::write(const VMValuePtr &vmvalue, uint64_t bytes)
+{
+    if(vmvalue->value_bits != -1)
+        return false; // Would need the rest of the unit
+
+    const uint8_t* data = static_cast<const VMValue&>(*vmvalue).value_ref<uint8_t>();
+    ScalarStorer storer = SCALAR_STORERS[vmvalue->is_swapped()][vmvalue->value_type]; // Byte order it was read with
+
+    if(storer && (bytes <= sizeof(uint64_t)))
+    {
+        uint8_t buffer[sizeof(uint64_t)];
+        storer(data, buffer);
+        return this->writeAt(vmvalue->value_offset, buffer, bytes);
+    }
+
+    if(!vmvalue->is_string() || (vmvalue->s_value.size() >= bytes))
+        return this->writeAt(vmvalue->value_offset, data, bytes);
+
+    std::vector<uint8_t> buffer(bytes, 0); // Shorter strings are padded to the original size
+    std::copy(data, data + vmvalue->s_value.size(), buffer.begin());
+    return this->writeAt(vmvalue->value_offset, buffer.data(), bytes);
+}
+
+bool BTVMIO::writeAt(uint64_t offset, const uint8_t *data, uint64_t size)
+{
+    if((offset > this->size()) || (size > this->size() - offset))
+        return false; // Inputs don't grow
+
+    std::lock_guard<std::mutex> lock(this->_iomutex);
+    this->_journal.write(offset, data, size);
+    this->_cache->update(offset, data, size);
+    this->_stats.queued_writes++;
+
+    if((offset < this->_windowoffset + this->_windowsize) && (offset + size > this->_windowoffset))
+        this->dropWindow(); // Mapped windows don't see the journal
+
+    return true;
+}
+
+bool BTVMIO::commit()
+{
+    if(this->_journal.empty())
+        return true;
+
+    bool res;
+
+    {
+        std::lock_guard<std::mutex> lock(this->_iomutex);
+
+        res = this->_journal.apply([this](uint64_t offset, const uint8_t* data, uint64_t size) {
+            uint64_t count = this->writeData(offset, data, size);
+            this->_stats.write_calls++;
+            this->_stats.write_bytes += count;
+            return count;
+        });
+
+        this->dropRegion(); // Holes may have been filled
+    }
+
+    if(this->_readahead)
+        this->setReadahead(this->_readaheaddepth); // Blocks loaded ahead were only patched when taken
+
+    return res;
+}
+
+void BTVMIO::discardWrites()
+{
+    std::lock_guard<std::mutex> lock(this->_iomutex);
+
+    if(this->_journal.empty())
+        return;
+
+    this->_journal.clear();
+    this->_cache->clear(); // Patched blocks
+    this->dropWindow();
+}
+
 uint64_t BTVMIO::offset() const
 {
-    return this->_cursor.position;
+    if(!this->_cursor.hasBits() || this->_cursor.unit_size)
+        return this->_cursor.position;
+
+    return this->_cursor.position - (this->_cursor.word_bits / PLATFORM_BITS); // Unpadded bits give back whole bytes
 }
 
 bool BTVMIO::atEof() const
 {
-    if(!this->_buffer || this->_cursor.hasBits() || !this->_cursor.moved)
+    if(this->_cursor.hasBits() || !this->_cursor.moved)
         return false;
 
-    return (this->_buffersize < BUFFER_SIZE) && (this->_cursor.rel_position >= this->_buffersize);
+    return this->atDataEnd();
+}
+
+BTVMIOStats BTVMIO::stats() const
+{
+    std::lock_guard<std::mutex> lock(this->_iomutex);
+    return this->_stats;
+}
+
+void BTVMIO::resetStats()
+{
+    std::lock_guard<std::mutex> lock(this->_iomutex);
+    this->_stats = BTVMIOStats();
+}
+
+void BTVMIO::setBlockCache(uint64_t blocks, uint64_t blocksize)
+{
+    delete this->_cache;
+    this->_cache = new BlockCache(std::max<uint64_t>(blocks, 1), std::max<uint64_t>(blocksize, 1));
+
+    this->dropWindow(); // Next read loads a window from the new cache
+    this->setReadahead(this->_readaheaddepth);
+}
+
+void BTVMIO::setReadahead(uint64_t depth)
+{
+    delete this->_readahead;
+    this->_readahead = NULL;
+    this->_readaheaddepth = depth;
+
+    if(depth)
+        this->_readahead = new Readahead(depth, this->_cache->blockSize(), [this](uint64_t offset, uint8_t* buffer, uint64_t size) { return this->fetchData(offset, buffer, size); });
+}
+
+void BTVMIO::setTrace(const std::string &file)
+{
+    delete this->_trace;
+    this->_trace = NULL;
+
+    if(!file.empty())
+        this->_trace = new AccessTrace(file, this->size());
+}
+
+bool BTVMIO::seekable(uint64_t offset)
+{
+    VMUnused(offset);
+    return true;
 }
 
 void BTVMIO::seek(uint64_t offset)
 {
+    if(offset > this->_cursor.position)
+        this->_stats.forward_seeks++;
+    else if(offset < this->_cursor.position)
+        this->_stats.backward_seeks++;
+    else
+        this->_stats.noop_seeks++;
+
+    if(this->_trace)
+        this->_trace->record(AccessTrace::Seek, offset, 0);
+
+    this->_cursor.dropBits();
+
+    if(this->inWindow(offset))
+    {
+        this->_cursor.rewind();
+        this->_cursor.position = offset;
+        this->_cursor.rel_position = offset - this->_windowoffset;
+        this->_stats.avoided_refills++;
+        return;
+    }
+
     this->_cursor.position = offset;
     this->updateBuffer();
 }
@@ -106,95 +451,405 @@ void BTVMIO::setBigEndian()
     this->_endianness = BTEndianness::BigEndian;
 }
 
-uint8_t BTVMIO::readBit()
+void BTVMIO::setBitfieldLeftToRight()
+{
+    this->_bitfieldorder = BitfieldLeftToRight;
+}
+
+void BTVMIO::setBitfieldRightToLeft()
 {
-    uint8_t* sbuffer = this->_buffer + this->_cursor.rel_position;
-    uint8_t val = (*sbuffer & (1u << this->_cursor.bit)) >> this->_cursor.bit;
+    this->_bitfieldorder = BitfieldRightToLeft;
+}
 
-    this->_cursor.bit++;
+void BTVMIO::setBitfieldPadding(bool b)
+{
+    this->_bitfieldpadding = b;
+}
 
-    if(this->_cursor.bit == PLATFORM_BITS)
+uint64_t BTVMIO::blockSize() const
+{
+    return this->_cache->blockSize();
+}
+
+uint64_t BTVMIO::fetchData(uint64_t offset, uint8_t *buffer, uint64_t size)
+{
+    std::lock_guard<std::mutex> lock(this->_iomutex); // Implementations don't have to be thread safe
+    uint64_t count = 0;
+
+    while(count < size)
     {
-        this->_cursor++;
-        this->_cursor.bit = 0;
+        uint64_t end, pos = offset + count;
+        bool hole = this->regionAt(pos, end);
+        uint64_t chunk = std::min(size - count, end - pos);
+
+        if(hole)
+        {
+            std::memset(buffer + count, 0, chunk); // Nothing is stored there
+            this->_stats.hole_bytes += chunk;
+            count += chunk;
+            continue;
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        uint64_t res = this->readData(pos, buffer + count, chunk);
+
+        this->_stats.read_calls++;
+        this->_stats.read_bytes += res;
+        this->_stats.read_nanoseconds += static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count());
+        count += res;
+
+        if(res < chunk)
+            break;
+    }
+
+    if(!this->_journal.empty())
+        this->_journal.overlay(offset, buffer, count); // Reads see pending writes
+
+    return count;
+}
+
+void BTVMIO::dropRegion()
+{
+    this->_regionstart = this->_regionend = 0;
+    this->_regionhole = false;
+}
+
+bool BTVMIO::regionAt(uint64_t offset, uint64_t &end)
+{
+    if((offset < this->_regionstart) || (offset >= this->_regionend))
+    {
+        uint64_t datastart = this->findData(offset, false);
+        this->_regionstart = offset;
+        this->_regionhole = datastart > offset;
+        this->_regionend = this->_regionhole ? std::min(datastart, this->size()) : this->findData(offset, true);
+
+        if(this->_regionend <= offset) // Past the end, readData() decides
+        {
+            this->_regionhole = false;
+            this->_regionend = UINT64_MAX;
+        }
     }
 
-    return val;
+    end = this->_regionend;
+    return this->_regionhole;
 }
 
-uint8_t* BTVMIO::updateBuffer()
+const uint8_t* BTVMIO::updateBuffer()
 {
-    this->_buffersize = this->readData(this->_buffer, BUFFER_SIZE);
+    if(this->mapWindow())
+        return this->_window;
+
+    BlockCache::Block* block = this->_cache->find(this->_cursor.position);
+
+    if(block)
+        this->_stats.cache_hits++;
+    else
+    {
+        block = this->_cache->replace(this->_cursor.position);
+        this->_stats.cache_misses++;
+
+        if(this->_readahead && this->_readahead->take(block->offset, block->data, block->size))
+        {
+            std::lock_guard<std::mutex> lock(this->_iomutex);
+            this->_journal.overlay(block->offset, block->data, block->size); // Loaded before the last writes, maybe
+            this->_stats.readahead_hits++;
+        }
+        else
+            block->size = this->fetchData(block->offset, block->data, this->_cache->blockSize());
+
+        if(this->_readahead)
+            this->_readahead->access(block->offset);
+    }
+
+    this->_window = block->data;
+    this->_windowoffset = block->offset;
+    this->_windowsize = block->size;
+    this->_windowlast = block->size < this->_cache->blockSize();
+    this->_stats.refills++;
     this->_cursor.rewind();
-    return this->_buffer;
+    this->_cursor.rel_position = this->_cursor.position - block->offset;
+    return this->_window;
 }
 
-bool BTVMIO::atBufferEnd() const
+bool BTVMIO::mapWindow()
+{
+    uint64_t size = 0;
+    const uint8_t* data = this->mapRange(this->_cursor.position, size, false); // Replaced by the next refill
+
+    if(!data)
+        return false;
+
+    this->_window = data; // Serve reads in place
+    this->_windowoffset = this->_cursor.position;
+    this->_windowsize = size;
+    this->_windowlast = (this->_cursor.position + size) >= this->size();
+    this->_stats.refills++;
+    this->_cursor.rewind();
+    return true;
+}
+
+void BTVMIO::dropWindow()
 {
-    if(this->_cursor.hasBits())
+    this->_window = NULL;
+    this->_windowoffset = this->_cursor.position;
+    this->_windowsize = 0;
+    this->_windowlast = false;
+    this->_cursor.rel_position = 0;
+}
+
+bool BTVMIO::inWindow(uint64_t offset) const
+{
+    if(offset < this->_windowoffset)
         return false;
 
-    return this->_cursor.rel_position >= this->_buffersize;
+    uint64_t reloffset = offset - this->_windowoffset;
+    return (reloffset < this->_windowsize) || (this->_windowlast && (reloffset == this->_windowsize));
+}
+
+bool BTVMIO::atBufferEnd() const
+{
+    return this->_cursor.rel_position >= this->_windowsize;
+}
+
+bool BTVMIO::atDataEnd() const
+{
+    return this->_windowlast && this->atBufferEnd();
+}
+
+bool BTVMIO::bitfieldLeftToRight() const
+{
+    if(this->_bitfieldorder == BitfieldDefault)
+        return this->_endianness == BTEndianness::BigEndian;
+
+    return this->_bitfieldorder == BitfieldLeftToRight;
 }
 
 void BTVMIO::alignCursor()
 {
-    if(!this->_cursor.hasBits() || !this->_cursor.size)
+    if(!this->_cursor.hasBits())
         return;
 
-    this->_cursor.position = align_to(this->_cursor.position, this->_cursor.size);
-    this->_cursor.rel_position = align_to(this->_cursor.rel_position, this->_cursor.size);
-    this->_cursor.size = this->_cursor.bit = 0;
+    uint64_t unread = this->_cursor.unit_size ? 0 : (this->_cursor.word_bits / PLATFORM_BITS); // Unpadded bits give back whole bytes
+    this->_cursor.dropBits();
+
+    if(unread)
+        this->seek(this->_cursor.position - unread);
 }
 
-void BTVMIO::readBytes(uint8_t *buffer, uint64_t bytescount)
+uint64_t BTVMIO::readBytes(uint8_t *buffer, uint64_t bytescount)
 {
-    uint8_t* sbuffer = this->_buffer + this->_cursor.rel_position;
-    uint8_t* dbuffer = buffer;
+    uint64_t count = bytescount, start = this->_cursor.position;
 
-    for(uint64_t i = 0; i < bytescount && !this->atEof(); i++)
+    while(bytescount && !this->atDataEnd())
     {
-        if(this->atBufferEnd())
-            sbuffer = this->updateBuffer();
+        if(!this->atBufferEnd())
+        {
+            uint64_t span = std::min(bytescount, this->_windowsize - this->_cursor.rel_position);
+            std::memcpy(buffer, this->_window + this->_cursor.rel_position, span);
+            this->_cursor.advance(span);
+            buffer += span;
+            bytescount -= span;
+        }
+        else if(bytescount < this->_cache->blockSize())
+            this->updateBuffer();
+        else if(!this->mapWindow()) // Large reads bypass the cache
+        {
+            uint64_t datasize = this->fetchData(this->_cursor.position, buffer, bytescount);
+
+            this->_windowsize = 0;
+            this->_windowlast = datasize < bytescount;
+            this->_cursor.rewind();
+            this->_cursor.position += datasize;
+            this->_windowoffset = this->_cursor.position;
+            buffer += datasize;
+            bytescount -= datasize;
+        }
+    }
 
-        *dbuffer = *sbuffer;
-        sbuffer++; dbuffer++;
+    this->_stats.delivered_bytes += count - bytescount;
 
-        this->_cursor++;
+    if(this->_trace)
+        this->_trace->record(AccessTrace::Read, start, count - bytescount);
+
+    return count - bytescount;
+}
+
+void BTVMIO::readBits(const VMValuePtr &vmvalue, uint64_t bitscount, uint64_t unitsize)
+{
+    if(!bitscount) // Zero width fields close the current unit
+    {
+        this->alignCursor();
+        return;
+    }
+
+    uint64_t value, offset;
+    unitsize = std::max<uint64_t>(1, std::min<uint64_t>(unitsize, sizeof(uint64_t)));
+    bitscount = std::min<uint64_t>(bitscount, this->_bitfieldpadding ? (unitsize * PLATFORM_BITS) : 64); // Wider fields are truncated, sign included
+
+    if(this->_bitfieldpadding)
+        value = this->readUnitBits(bitscount, unitsize, offset);
+    else
+        value = this->readStreamBits(bitscount, offset);
+
+    vmvalue->value_offset = offset; // Bitfields are located at their unit, not at the cursor
+    vmvalue->value_flags |= VMValueFlags::Input;
+
+    if(vmvalue->is_integer() || vmvalue->is_enum())
+    {
+        if(vmvalue->is_signed() && (bitscount < 64) && ((value >> (bitscount - 1)) & 1))
+            value |= ~0ull << bitscount; // Sign extend
+
+        *vmvalue->value_ref<uint64_t>() = value;
     }
+    else
+        std::memcpy(vmvalue->value_ref<uint8_t>(), &value, unitsize);
 }
 
-void BTVMIO::readBits(uint8_t *buffer, uint64_t bitscount)
+uint64_t BTVMIO::readUnitBits(uint64_t bitscount, uint64_t unitsize, uint64_t& offset)
 {
-    uint8_t* dbuffer = buffer;
+    uint64_t unitbits = unitsize * PLATFORM_BITS;
 
-    for(uint64_t i = 0; i < bitscount && !this->atEof(); i++)
+    if(this->_cursor.hasBits() && ((this->_cursor.unit_size != unitsize) || (bitscount > this->_cursor.word_bits)))
+        this->_cursor.dropBits(); // Doesn't fit, the rest of the unit is padding
+
+    if(!this->_cursor.hasBits())
     {
-        if(this->atBufferEnd())
-            this->updateBuffer();
+        uint8_t data[sizeof(uint64_t)] = { 0 };
+        uint64_t word = 0;
+        this->_cursor.unit_offset = this->_cursor.position;
+        this->readBytes(data, unitsize);
+
+        for(uint64_t i = 0; i < unitsize; i++)
+            word |= static_cast<uint64_t>(data[i]) << (PLATFORM_BITS * ((this->_endianness == BTEndianness::BigEndian) ? (unitsize - i - 1) : i));
+
+        if(this->bitfieldLeftToRight() && (unitbits < 64))
+            word <<= 64 - unitbits; // Keep the first field in the high bits
+
+        this->_cursor.word = word;
+        this->_cursor.word_bits = unitbits;
+        this->_cursor.unit_size = unitsize;
+    }
+
+    offset = this->_cursor.unit_offset;
+    uint64_t value = this->takeBits(bitscount);
+
+    if(!this->_cursor.hasBits())
+        this->_cursor.unit_size = 0;
+
+    return value;
+}
 
-        *dbuffer |= this->readBit();
+uint64_t BTVMIO::readStreamBits(uint64_t bitscount, uint64_t& offset)
+{
+    bool lefttoright = this->bitfieldLeftToRight();
+    uint64_t value = 0, count = 0;
+    offset = this->_cursor.position - ((this->_cursor.word_bits + PLATFORM_BITS - 1) / PLATFORM_BITS); // Byte holding the first bit
 
-        if(!this->_cursor.bit)
+    while(count < bitscount)
+    {
+        if(!this->_cursor.hasBits())
         {
-            dbuffer++;
-            *dbuffer = 0;
+            uint8_t data[sizeof(uint64_t)];
+            uint64_t datasize = this->readBytes(data, std::min<uint64_t>((bitscount - count + PLATFORM_BITS - 1) / PLATFORM_BITS, sizeof(uint64_t)));
+
+            if(!datasize)
+                break;
+
+            this->_cursor.word = 0;
+
+            for(uint64_t i = 0; i < datasize; i++)
+                this->_cursor.word |= static_cast<uint64_t>(data[i]) << (PLATFORM_BITS * (lefttoright ? (sizeof(uint64_t) - i - 1) : i));
+
+            this->_cursor.word_bits = datasize * PLATFORM_BITS;
         }
+
+        uint64_t n = std::min(bitscount - count, this->_cursor.word_bits);
+        uint64_t bits = this->takeBits(n);
+
+        if(lefttoright)
+            value = (n < 64) ? ((value << n) | bits) : bits;
+        else
+            value |= bits << count;
+
+        count += n;
     }
+
+    return value;
+}
+
+uint64_t BTVMIO::takeBits(uint64_t bitscount)
+{
+    uint64_t value;
+
+    if(this->bitfieldLeftToRight())
+    {
+        value = this->_cursor.word >> (64 - bitscount);
+        this->_cursor.word = (bitscount < 64) ? (this->_cursor.word << bitscount) : 0;
+    }
+    else
+    {
+        value = (bitscount < 64) ? (this->_cursor.word & ((1ull << bitscount) - 1)) : this->_cursor.word;
+        this->_cursor.word = (bitscount < 64) ? (this->_cursor.word >> bitscount) : 0;
+    }
+
+    this->_cursor.word_bits -= bitscount;
+    return value;
+}
+
+void BTVMIO::prefetchData(uint64_t offset, uint64_t size)
+{
+    if(!this->_readahead)
+        return;
+
+    uint64_t end = offset + size;
+
+    if(this->inWindow(offset))
+        offset = this->_windowoffset + this->_windowsize; // Already loaded
+
+    if(offset < end)
+        this->_readahead->hint(offset, end - offset);
+}
+
+uint64_t BTVMIO::findData(uint64_t offset, bool hole)
+{
+    return hole ? UINT64_MAX : offset; // No holes by default
+}
+
+uint64_t BTVMIO::seekData(int fd, uint64_t offset, bool hole)
+{
+    off_t res = lseek(fd, static_cast<off_t>(offset), hole ? SEEK_HOLE : SEEK_DATA);
+
+    if(res >= 0)
+        return static_cast<uint64_t>(res);
+
+    if(!hole && (errno != ENXIO))
+        return offset; // Not supported by the file system, everything is data
+
+    return UINT64_MAX; // ENXIO: no data after 'offset', or past the end
+}
+
+bool BTVMIO::writable() const
+{
+    return false;
+}
+
+uint64_t BTVMIO::writeData(uint64_t offset, const uint8_t *data, uint64_t size)
+{
+    VMUnused(offset);
+    VMUnused(data);
+    VMUnused(size);
+    return 0;
+}
+
+const uint8_t *BTVMIO::mapData(uint64_t offset, uint64_t &size, bool pin)
+{
+    VMUnused(offset);
+    VMUnused(size);
+    VMUnused(pin);
+    return NULL; // Data is copied through readData() by default
 }
 
-void BTVMIO::elaborateEndianness(const VMValuePtr &vmvalue) const
+bool BTVMIO::swapsBytes() const
 {
-    if(vmvalue->value_type == VMValueType::s16)
-        *vmvalue->value_ref<uint64_t>() = this->elaborateEndianness(*vmvalue->value_ref<int16_t>());
-    else if((vmvalue->value_type == VMValueType::s32) || (vmvalue->value_type == VMValueType::Float))
-        *vmvalue->value_ref<uint64_t>() = this->elaborateEndianness(*vmvalue->value_ref<int32_t>());
-    else if((vmvalue->value_type == VMValueType::s64) || (vmvalue->value_type == VMValueType::Double))
-        *vmvalue->value_ref<uint64_t>() = this->elaborateEndianness(*vmvalue->value_ref<int64_t>());
-    else if(vmvalue->value_type == VMValueType::u16)
-        *vmvalue->value_ref<uint64_t>() = this->elaborateEndianness(*vmvalue->value_ref<uint16_t>());
-    else if(vmvalue->value_type == VMValueType::u32)
-        *vmvalue->value_ref<uint64_t>() = this->elaborateEndianness(*vmvalue->value_ref<uint32_t>());
-    else if(vmvalue->value_type == VMValueType::u64)
-        *vmvalue->value_ref<uint64_t>() = this->elaborateEndianness(*vmvalue->value_ref<uint64_t>());
+    return this->_platformendianness != this->_endianness;
 }
@@ -2,28 +2,68 @@
 #define BTVMIO_H
 
 #include <functional>
+#include <mutex>
 #include "vm/vmvalue.h"
 #include "vm/vm_functions.h"
 #include "format/btentry.h"
+#include "io/blockcache.h"
+#include "io/readahead.h"
+#include "io/accesstrace.h"
+#include "io/writejournal.h"
 
 #define IO_NoSeek(btvmio) BTVMIO::NoSeek __noseek__(btvmio)
 
+enum BTBitfieldOrder
+{
+    BitfieldDefault, // Follows endianness
+    BitfieldLeftToRight,
+    BitfieldRightToLeft,
+};
+
+struct BTVMIOStats
+{
+    BTVMIOStats(): read_calls(0), read_bytes(0), read_nanoseconds(0), delivered_bytes(0), forward_seeks(0), backward_seeks(0), noop_seeks(0),
+                   hole_bytes(0), queued_writes(0), write_calls(0), write_bytes(0), refills(0), avoided_refills(0), noseek_restores(0), cache_hits(0), cache_misses(0), readahead_hits(0) { }
+
+    uint64_t read_calls; // readData() calls, readahead thread included
+    uint64_t read_bytes; // Bytes returned by readData()
+    uint64_t read_nanoseconds; // Time spent blocked in readData()
+    uint64_t delivered_bytes; // Bytes consumed by the VM
+    uint64_t forward_seeks;
+    uint64_t backward_seeks;
+    uint64_t noop_seeks; // Seeks to the current position
+    uint64_t hole_bytes; // Zeros synthesized for holes, without calling readData()
+    uint64_t queued_writes; // writeAt() calls
+    uint64_t write_calls; // writeData() calls, coalesced by commit()
+    uint64_t write_bytes;
+    uint64_t refills; // Window loads
+    uint64_t avoided_refills; // Seeks served by the current window
+    uint64_t noseek_restores; // Positions restored after a look-ahead (unions, ReadXXX() functions...)
+    uint64_t cache_hits;
+    uint64_t cache_misses;
+    uint64_t readahead_hits; // Cache misses served by the readahead thread
+};
+
 class BTVMIO
 {
     private:
         struct BitCursor {
-            BitCursor(): position(0), rel_position(0), bit(0), size(0), moved(false) { }
-            void rewind() { rel_position = bit = size = 0; moved = true; }
-            bool hasBits() const { return bit > 0; }
-            BitCursor& operator++(int) { position++; rel_position++; moved = true; return *this; }
-            uint64_t position, rel_position, bit, size;
+            BitCursor(): position(0), rel_position(0), word(0), word_bits(0), unit_size(0), unit_offset(0), moved(false) { }
+            void rewind() { rel_position = 0; moved = true; }
+            void advance(uint64_t n) { position += n; rel_position += n; moved = true; }
+            void dropBits() { word = word_bits = unit_size = 0; }
+            void restoreBits(const BitCursor& c) { word = c.word; word_bits = c.word_bits; unit_size = c.unit_size; unit_offset = c.unit_offset; }
+            bool hasBits() const { return word_bits > 0; }
+            uint64_t position, rel_position;
+            uint64_t word, word_bits, unit_size; // Bitfield bits loaded but not consumed yet, unit_size is 0 without padding
+            uint64_t unit_offset; // Where the loaded unit starts, reads at EOF may be short
             bool moved;
         };
 
     public:
         struct NoSeek {
             NoSeek(BTVMIO* btvmio): _btvmio(btvmio), _oldcursor(_btvmio->_cursor) { }
-            ~NoSeek() { _btvmio->seek(_oldcursor.position); }
+            ~NoSeek() { _btvmio->_stats.noseek_restores++; _btvmio->seek(_oldcursor.position); _btvmio->_cursor.restoreBits(_oldcursor); }
 
             private:
                 BTVMIO* _btvmio;
@@ -32,60 +72,93 @@ class BTVMIO
 
     public:
         BTVMIO();
-        virtual ~BTVMIO();
+        virtual ~BTVMIO(); // Implementations call setReadahead(0) first in their destructor, readData() must not run on a half destroyed object
         void read(const VMValuePtr &vmvalue, uint64_t bytes);
+        void readArray(const VMValueMembers& vmvalues, uint64_t bytes); // Scalars of the same type, back to back
         void readString(const VMValuePtr &vmvalue, int64_t maxlen);
         void walk(uint64_t steps);
+        uint64_t readAt(uint64_t offset, uint8_t* buffer, uint64_t size); // Raw data, the cursor doesn't move
+        const uint8_t* mapAt(uint64_t offset, uint64_t& size); // Like readAt(), in place, NULL if the data isn't mapped, valid as long as the IO
+        void prefetch(uint64_t offset, uint64_t size); // Hint: [offset, offset + size) is going to be read
+        bool holeAt(uint64_t offset, uint64_t& end); // True if 'offset' is in a hole, 'end' is where the hole (or the data) ends
+        void resetHoles(); // Forgets the last hole found, the input may have changed
+        bool write(const VMValuePtr& vmvalue, uint64_t bytes); // Queues 'vmvalue' at its offset, bitfields aren't supported
+        bool writeAt(uint64_t offset, const uint8_t* data, uint64_t size); // Queued until commit(), reads see it at once
+        bool commit(); // Applies queued writes in one sorted pass
+        void discardWrites();
         uint64_t offset() const;
         bool atEof() const;
+        BTVMIOStats stats() const;
+        void resetStats();
+        void setBlockCache(uint64_t blocks, uint64_t blocksize);
+        void setReadahead(uint64_t depth); // readData() is called from another thread, disable it before destroying the implementation
+        void setTrace(const std::string& file); // Records accesses to 'file', an empty name stops recording
 
     public:
+        virtual bool seekable(uint64_t offset); // False when data at 'offset' has been discarded (streams)
         virtual void seek(uint64_t offset);
         virtual uint64_t size() const = 0;
+        virtual bool writable() const; // False unless the implementation supports writeData()
 
     public:
         int endianness() const;
         void setLittleEndian();
         void setBigEndian();
+        void setBitfieldLeftToRight();
+        void setBitfieldRightToLeft();
+        void setBitfieldPadding(bool b);
 
     private:
-        uint8_t readBit();
-        uint8_t *updateBuffer();
+        uint64_t fetchData(uint64_t offset, uint8_t* buffer, uint64_t size);
+        bool regionAt(uint64_t offset, uint64_t& end);
+        void dropRegion();
+        const uint8_t *updateBuffer();
+        const uint8_t* mapRange(uint64_t offset, uint64_t& size, bool pin);
+        bool mapWindow();
+        void dropWindow();
+        bool inWindow(uint64_t offset) const;
         bool atBufferEnd() const;
+        bool atDataEnd() const;
+        bool bitfieldLeftToRight() const;
         void alignCursor();
-        void readBytes(uint8_t* buffer, uint64_t bytescount);
-        void readBits(uint8_t* buffer, uint64_t bitscount);
+        uint64_t readBytes(uint8_t* buffer, uint64_t bytescount);
+        void readBits(const VMValuePtr& vmvalue, uint64_t bitscount, uint64_t unitsize);
+        uint64_t readUnitBits(uint64_t bitscount, uint64_t unitsize, uint64_t& offset);
+        uint64_t readStreamBits(uint64_t bitscount, uint64_t& offset);
+        uint64_t takeBits(uint64_t bitscount);
 
     protected:
-        virtual uint64_t readData(uint8_t* buffer, uint64_t size) = 0;
+        uint64_t blockSize() const;
+        virtual const uint8_t* mapData(uint64_t offset, uint64_t& size, bool pin); // Data at 'offset' in place, NULL uses readData(), unpinned data lives until the next unpinned call
+        virtual uint64_t readData(uint64_t offset, uint8_t* buffer, uint64_t size) = 0;
+        virtual void prefetchData(uint64_t offset, uint64_t size); // Hints the readahead thread, if any
+        virtual uint64_t findData(uint64_t offset, bool hole); // First data (or hole) at or after 'offset', UINT64_MAX if none
+        virtual uint64_t writeData(uint64_t offset, const uint8_t* data, uint64_t size); // Inputs are read only by default
+        static uint64_t seekData(int fd, uint64_t offset, bool hole); // findData() with SEEK_DATA/SEEK_HOLE
 
     private:
-        template<typename T> T elaborateEndianness(T valueref) const;
-        void elaborateEndianness(const VMValuePtr &vmvalue) const;
+        bool swapsBytes() const;
 
     private:
         static const int PLATFORM_ENDIANNESS;
         int _platformendianness;
         int _endianness;
+        int _bitfieldorder;
+        bool _bitfieldpadding;
         BitCursor _cursor;
-        uint64_t _buffersize;
-        uint8_t* _buffer;
+        BTVMIOStats _stats;
+        const uint8_t* _window;
+        uint64_t _windowoffset;
+        uint64_t _windowsize;
+        bool _windowlast;
+        BlockCache* _cache;
+        Readahead* _readahead;
+        uint64_t _readaheaddepth;
+        AccessTrace* _trace;
+        WriteJournal _journal;
+        uint64_t _regionstart, _regionend; // Last data or hole region found
+        bool _regionhole;
+        mutable std::mutex _iomutex; // Also guards readData() counters
 };
 
-template<typename T> T BTVMIO::elaborateEndianness(T value) const
-{
-    if(this->_platformendianness == this->_endianness)
-        return value;
-
-    uint8_t *start, *end;
-
-    for(start = reinterpret_cast<uint8_t*>(&value), end = start + sizeof(T) - 1; start < end; ++start, --end)
-    {
-        uint8_t swap = *start;
-        *start = *end;
-        *end = swap;
-    }
-
-    return value;
-}
 #endif // BTVMIO_H
@@ -29,10 +29,10 @@ typedef std::vector<BTEntryPtr> BTEntryList;
 
 struct BTEntry
 {
-    BTEntry() { }
+    BTEntry(): name(SymbolNone) { }
     BTEntry(const VMValuePtr& value, size_t endianness): name(value->value_id), value(value), endianness(endianness) { }
 
-    std::string name;
+    VMSymbol name;
     VMValuePtr value;
     BTLocation location;
     size_t endianness;
@@ -0,0 +1,94 @@
+#include "accesstrace.h"
+#include <stdexcept>
+#include <cstring>
+
+#define TRACE_MAGIC "BTVMTRC1"
+
+AccessTrace::AccessTrace(const std::string &file, uint64_t size): _lastend(0)
+{
+    this->_fp = std::fopen(file.c_str(), "wb");
+
+    if(!this->_fp)
+        throw std::runtime_error("Cannot create '" + file + "'");
+
+    std::fwrite(TRACE_MAGIC, 1, 8, this->_fp);
+    std::fwrite(&size, sizeof(uint64_t), 1, this->_fp);
+}
+
+AccessTrace::~AccessTrace()
+{
+    std::fclose(this->_fp);
+}
+
+void AccessTrace::record(AccessTrace::Kind kind, uint64_t offset, uint64_t length)
+{
+    int64_t delta = static_cast<int64_t>(offset - this->_lastend);
+
+    std::fputc(kind, this->_fp);
+    this->writeVarint((static_cast<uint64_t>(delta) << 1) ^ static_cast<uint64_t>(delta >> 63)); // Zigzag, backward jumps stay short
+    this->writeVarint(length);
+    this->_lastend = offset + length;
+}
+
+bool AccessTrace::replay(const std::string &file, uint64_t &size, const AccessTrace::Visitor &visitor)
+{
+    FILE* fp = std::fopen(file.c_str(), "rb");
+
+    if(!fp)
+        return false;
+
+    char magic[8] = { 0 };
+
+    if((std::fread(magic, 1, sizeof(magic), fp) != sizeof(magic)) || std::memcmp(magic, TRACE_MAGIC, sizeof(magic)) || (std::fread(&size, sizeof(uint64_t), 1, fp) != 1))
+    {
+        std::fclose(fp);
+        return false;
+    }
+
+    uint64_t lastend = 0, zigzag = 0, length = 0;
+    int kind;
+
+    while((kind = std::fgetc(fp)) != EOF)
+    {
+        if((kind > Raw) || !readVarint(fp, zigzag) || !readVarint(fp, length))
+            break; // Truncated by a crash, keep what was recorded
+
+        uint64_t offset = lastend + ((zigzag >> 1) ^ (~(zigzag & 1) + 1));
+        visitor(static_cast<Kind>(kind), offset, length);
+        lastend = offset + length;
+    }
+
+    std::fclose(fp);
+    return true;
+}
+
+void AccessTrace::writeVarint(uint64_t value)
+{
+    while(value >= 0x80)
+    {
+        std::fputc(static_cast<int>((value & 0x7F) | 0x80), this->_fp);
+        value >>= 7;
+    }
+
+    std::fputc(static_cast<int>(value), this->_fp);
+}
+
+bool AccessTrace::readVarint(FILE *fp, uint64_t &value)
+{
+    value = 0;
+
+    for(unsigned int shift = 0; shift < 64; shift += 7)
+    {
+        int c = std::fgetc(fp);
+
+        if(c == EOF)
+            return false;
+
+        value |= static_cast<uint64_t>(c & 0x7F) << shift;
+
+        if(!(c & 0x80))
+            return true;
+    }
+
+    return false;
+}
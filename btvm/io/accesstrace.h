@@ -0,0 +1,38 @@
+#ifndef ACCESSTRACE_H
+#define ACCESSTRACE_H
+
+#include <functional>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+/*
+ * Compact binary log of the accesses a template makes to its input.
+ * Each record is a kind byte followed by two varints: the distance from the
+ * end of the previous access (zigzag encoded) and the length, so sequential
+ * parses cost about 3 bytes per access.
+ */
+class AccessTrace
+{
+    public:
+        enum Kind { Read = 0, Seek, Raw }; // Raw: BTVMIO::readAt(), bypasses the window and the cache
+        typedef std::function<void(Kind, uint64_t, uint64_t)> Visitor; // Kind, offset, length
+
+    public:
+        AccessTrace(const std::string& file, uint64_t size); // 'size' is the input's size
+        ~AccessTrace();
+        void record(Kind kind, uint64_t offset, uint64_t length);
+
+    public:
+        static bool replay(const std::string& file, uint64_t& size, const Visitor& visitor);
+
+    private:
+        void writeVarint(uint64_t value);
+        static bool readVarint(FILE* fp, uint64_t& value);
+
+    private:
+        FILE* _fp;
+        uint64_t _lastend; // End of the previous access
+};
+
+#endif // ACCESSTRACE_H
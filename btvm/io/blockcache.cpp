@@ -0,0 +1,75 @@
+#include "blockcache.h"
+#include <algorithm>
+#include <cstring>
+
+#define InvalidBlock UINT64_MAX
+
+BlockCache::BlockCache(uint64_t blocks, uint64_t blocksize): _blocksize(blocksize)
+{
+    this->_storage.resize(blocks * blocksize);
+
+    for(uint64_t i = 0; i < blocks; i++)
+        this->_lru.push_back({ InvalidBlock, 0, this->_storage.data() + (i * blocksize) });
+}
+
+uint64_t BlockCache::blockSize() const
+{
+    return this->_blocksize;
+}
+
+uint64_t BlockCache::blockOffset(uint64_t offset) const
+{
+    return offset - (offset % this->_blocksize);
+}
+
+BlockCache::Block *BlockCache::find(uint64_t offset)
+{
+    auto it = this->_index.find(this->blockOffset(offset));
+
+    if(it == this->_index.end())
+        return NULL;
+
+    this->_lru.splice(this->_lru.begin(), this->_lru, it->second);
+    return &this->_lru.front();
+}
+
+BlockCache::Block *BlockCache::replace(uint64_t offset)
+{
+    this->_lru.splice(this->_lru.begin(), this->_lru, std::prev(this->_lru.end())); // Recycle the least recently used block
+    Block& block = this->_lru.front();
+
+    if(block.offset != InvalidBlock)
+        this->_index.erase(block.offset);
+
+    block.offset = this->blockOffset(offset);
+    block.size = 0;
+    this->_index[block.offset] = this->_lru.begin();
+    return &block;
+}
+
+void BlockCache::update(uint64_t offset, const uint8_t *data, uint64_t size)
+{
+    uint64_t end = offset + size;
+
+    for(uint64_t blockoffset = this->blockOffset(offset); blockoffset < end; blockoffset += this->_blocksize)
+    {
+        auto it = this->_index.find(blockoffset);
+
+        if(it == this->_index.end())
+            continue;
+
+        const Block& block = *it->second;
+        uint64_t start = std::max(offset, blockoffset), stop = std::min(end, blockoffset + block.size); // Bytes past EOF aren't cached
+
+        if(start < stop)
+            std::memcpy(block.data + (start - blockoffset), data + (start - offset), stop - start);
+    }
+}
+
+void BlockCache::clear()
+{
+    for(auto it = this->_lru.begin(); it != this->_lru.end(); it++)
+        it->offset = InvalidBlock;
+
+    this->_index.clear();
+}
@@ -0,0 +1,40 @@
+#ifndef BLOCKCACHE_H
+#define BLOCKCACHE_H
+
+#include <unordered_map>
+#include <cstdint>
+#include <vector>
+#include <list>
+
+/*
+ * Fixed size blocks keyed by their aligned file offset, evicted in LRU order.
+ */
+class BlockCache
+{
+    public:
+        struct Block {
+            uint64_t offset;
+            uint64_t size; // Valid bytes, less than the block size at EOF
+            uint8_t* data;
+        };
+
+    public:
+        BlockCache(uint64_t blocks, uint64_t blocksize);
+        uint64_t blockSize() const;
+        uint64_t blockOffset(uint64_t offset) const;
+        Block* find(uint64_t offset);
+        Block* replace(uint64_t offset);
+        void update(uint64_t offset, const uint8_t* data, uint64_t size); // Patches cached blocks, LRU order is kept
+        void clear();
+
+    private:
+        typedef std::list<Block> BlockList;
+
+    private:
+        std::unordered_map<uint64_t, BlockList::iterator> _index;
+        std::vector<uint8_t> _storage;
+        BlockList _lru; // Most recently used first
+        uint64_t _blocksize;
+};
+
+#endif // BLOCKCACHE_H
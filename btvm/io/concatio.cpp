@@ -0,0 +1,149 @@
+#include "concatio.h"
+#include "mappedfileio.h"
+#include <algorithm>
+
+ConcatIO::ConcatIO(const std::vector<BTVMIO *> &parts): BTVMIO(), _owned(false)
+{
+    this->_starts.push_back(0);
+
+    for(BTVMIO* part : parts)
+        this->addPart(part);
+}
+
+ConcatIO::ConcatIO(const std::vector<std::string> &files): BTVMIO(), _owned(true)
+{
+    this->_starts.push_back(0);
+
+    try
+    {
+        for(const std::string& file : files)
+            this->addPart(new MappedFileIO(file));
+    }
+    catch(...)
+    {
+        for(BTVMIO* part : this->_parts)
+            delete part;
+
+        throw;
+    }
+}
+
+ConcatIO::~ConcatIO()
+{
+    this->setReadahead(0); // Readahead thread calls readData()
+
+    if(!this->_owned)
+        return;
+
+    for(BTVMIO* part : this->_parts)
+        delete part;
+}
+
+uint64_t ConcatIO::size() const
+{
+    return this->_starts.back();
+}
+
+const uint8_t *ConcatIO::mapData(uint64_t offset, uint64_t &size, bool pin)
+{
+    VMUnused(pin); // mapAt() pins the part's data, our window may point there for a while
+    if(offset >= this->size())
+        return NULL;
+
+    size_t i = this->findPart(offset);
+    const uint8_t* data = this->_parts[i]->mapAt(offset - this->_starts[i], size);
+
+    if(data)
+        size = std::min(size, this->_starts[i + 1] - offset); // The window ends with the part
+
+    return data;
+}
+
+uint64_t ConcatIO::readData(uint64_t offset, uint8_t *buffer, uint64_t size)
+{
+    uint64_t count = 0;
+
+    if(offset >= this->size())
+        return 0;
+
+    for(size_t i = this->findPart(offset); (count < size) && (i < this->_parts.size()); i++)
+    {
+        uint64_t partoffset = offset + count - this->_starts[i];
+        uint64_t chunk = std::min(size - count, this->_starts[i + 1] - (offset + count));
+        uint64_t datasize = this->_parts[i]->readAt(partoffset, buffer + count, chunk);
+
+        count += datasize;
+
+        if(datasize < chunk)
+            break; // Part shrunk
+    }
+
+    return count;
+}
+
+bool ConcatIO::writable() const
+{
+    return std::all_of(this->_parts.begin(), this->_parts.end(), [](const BTVMIO* part) { return part->writable(); });
+}
+
+uint64_t ConcatIO::writeData(uint64_t offset, const uint8_t *data, uint64_t size)
+{
+    uint64_t count = 0;
+
+    if(offset >= this->size())
+        return 0;
+
+    for(size_t i = this->findPart(offset); (count < size) && (i < this->_parts.size()); i++)
+    {
+        uint64_t partoffset = offset + count - this->_starts[i];
+        uint64_t chunk = std::min(size - count, this->_starts[i + 1] - (offset + count));
+
+        if(!this->_parts[i]->writeAt(partoffset, data + count, chunk) || !this->_parts[i]->commit())
+            break;
+
+        count += chunk;
+    }
+
+    return count;
+}
+
+void ConcatIO::prefetchData(uint64_t offset, uint64_t size)
+{
+    uint64_t end = offset + size;
+
+    for(size_t i = this->findPart(offset); (i < this->_parts.size()) && (this->_starts[i] < end); i++)
+    {
+        uint64_t start = std::max(offset, this->_starts[i]);
+        this->_parts[i]->prefetch(start - this->_starts[i], std::min(end, this->_starts[i + 1]) - start);
+    }
+
+    BTVMIO::prefetchData(offset, size); // Our own cache, when parts aren't mapped
+}
+
+uint64_t ConcatIO::findData(uint64_t offset, bool hole)
+{
+    for(size_t i = this->findPart(offset); i < this->_parts.size(); i++)
+    {
+        uint64_t end, partoffset = std::max(offset, this->_starts[i]) - this->_starts[i], partsize = this->_starts[i + 1] - this->_starts[i];
+
+        for( ; partoffset < partsize; partoffset = end) // Parts keep track of their own holes
+        {
+            if(this->_parts[i]->holeAt(partoffset, end) == hole)
+                return this->_starts[i] + partoffset;
+        }
+    }
+
+    return UINT64_MAX;
+}
+
+void ConcatIO::addPart(BTVMIO *part)
+{
+    this->_parts.push_back(part);
+    this->_starts.push_back(this->_starts.back() + part->size());
+}
+
+size_t ConcatIO::findPart(uint64_t offset) const
+{
+    auto it = std::upper_bound(this->_starts.begin(), this->_starts.end(), offset); // Empty parts share their start with the next one
+    return static_cast<size_t>(std::distance(this->_starts.begin(), it)) - 1;
+}
@@ -0,0 +1,40 @@
+#ifndef CONCATIO_H
+#define CONCATIO_H
+
+#include <string>
+#include <vector>
+#include "../btvmio.h"
+
+/*
+ * BTVMIO presenting several BTVMIOs (split archives, multi-volume images...)
+ * as one contiguous input. Parts are located with a binary search over their
+ * start offsets, reads crossing a boundary are filled part by part straight
+ * into the caller's buffer. Part sizes are taken once, at construction.
+ */
+class ConcatIO: public BTVMIO
+{
+    public:
+        ConcatIO(const std::vector<BTVMIO*>& parts); // 'parts' are not deleted
+        ConcatIO(const std::vector<std::string>& files); // Mapped files, owned
+        ~ConcatIO();
+        virtual uint64_t size() const;
+        virtual bool writable() const; // All parts are
+
+    protected:
+        virtual const uint8_t* mapData(uint64_t offset, uint64_t& size, bool pin);
+        virtual uint64_t readData(uint64_t offset, uint8_t* buffer, uint64_t size);
+        virtual void prefetchData(uint64_t offset, uint64_t size);
+        virtual uint64_t findData(uint64_t offset, bool hole);
+        virtual uint64_t writeData(uint64_t offset, const uint8_t* data, uint64_t size);
+
+    private:
+        void addPart(BTVMIO* part);
+        size_t findPart(uint64_t offset) const;
+
+    private:
+        std::vector<BTVMIO*> _parts;
+        std::vector<uint64_t> _starts; // Offset of each part, plus the total size
+        bool _owned;
+};
+
+#endif // CONCATIO_H
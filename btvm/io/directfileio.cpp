@@ -0,0 +1,183 @@
+#include "directfileio.h"
+#include <algorithm>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+
+#define DIRECT_ALIGNMENT   4096u // Logical block size of any device we care about
+#define DIRECT_BOUNCE_SIZE (1024u * 1024u)
+#define DIRECT_BLOCK_SIZE  (256u * 1024u) // Each refill is a device request
+#define DIRECT_BLOCKS      4
+#define DROP_BATCH_SIZE    (8u * 1024u * 1024u)
+
+#define align_down(x) ((x) & ~static_cast<uint64_t>(DIRECT_ALIGNMENT - 1))
+#define is_aligned(x) (((x) & (DIRECT_ALIGNMENT - 1)) == 0)
+
+DirectFileIO::DirectFileIO(const std::string &file, DirectFileIO::Mode mode): BTVMIO(), _bounce(NULL), _dropstart(0), _dropend(0), _size(0), _mode(mode), _fd(-1)
+{
+    if(this->_mode == Direct)
+        this->_fd = open(file.c_str(), O_RDONLY | O_CLOEXEC | O_DIRECT);
+
+    if(this->_fd == -1)
+    {
+        this->_mode = DropBehind; // EINVAL: the filesystem doesn't support O_DIRECT
+        this->_fd = open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+
+    if(this->_fd == -1)
+        throw std::runtime_error("Cannot open '" + file + "'");
+
+    off_t size = lseek(this->_fd, 0, SEEK_END);
+
+    if(size > 0)
+        this->_size = static_cast<uint64_t>(size);
+
+    if(this->_mode == Direct)
+    {
+        void* bounce = NULL;
+
+        if(posix_memalign(&bounce, DIRECT_ALIGNMENT, DIRECT_BOUNCE_SIZE))
+        {
+            close(this->_fd);
+            throw std::runtime_error("Cannot allocate aligned buffer for '" + file + "'");
+        }
+
+        this->_bounce = static_cast<uint8_t*>(bounce);
+    }
+    else
+        posix_fadvise(this->_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+
+    this->setBlockCache(DIRECT_BLOCKS, DIRECT_BLOCK_SIZE); // Fewer, larger reads
+}
+
+DirectFileIO::~DirectFileIO()
+{
+    this->setReadahead(0); // Readahead thread calls readData()
+
+    if(this->_mode == DropBehind)
+        posix_fadvise(this->_fd, 0, 0, POSIX_FADV_DONTNEED); // Also pages read ahead by the kernel and never consumed
+
+    std::free(this->_bounce);
+    close(this->_fd);
+}
+
+uint64_t DirectFileIO::size() const
+{
+    return this->_size;
+}
+
+DirectFileIO::Mode DirectFileIO::mode() const
+{
+    return this->_mode;
+}
+
+uint64_t DirectFileIO::readData(uint64_t offset, uint8_t *buffer, uint64_t size)
+{
+    if(offset >= this->_size)
+        return 0;
+
+    size = std::min(size, this->_size - offset);
+
+    if(this->_mode == Direct)
+        return this->readDirect(offset, buffer, size);
+
+    return this->readBuffered(offset, buffer, size);
+}
+
+void DirectFileIO::prefetchData(uint64_t offset, uint64_t size)
+{
+    if(this->_mode == DropBehind)
+        posix_fadvise(this->_fd, static_cast<off_t>(offset), static_cast<off_t>(size), POSIX_FADV_WILLNEED);
+
+    BTVMIO::prefetchData(offset, size); // Direct reads only benefit from the readahead thread
+}
+
+uint64_t DirectFileIO::findData(uint64_t offset, bool hole)
+{
+    return BTVMIO::seekData(this->_fd, offset, hole);
+}
+
+uint64_t DirectFileIO::readDirect(uint64_t offset, uint8_t *buffer, uint64_t size)
+{
+    uint64_t count = 0;
+
+    while(count < size)
+    {
+        uint64_t pos = offset + count, remaining = size - count;
+
+        if(is_aligned(pos) && is_aligned(reinterpret_cast<uintptr_t>(buffer + count)) && (remaining >= DIRECT_ALIGNMENT))
+        {
+            uint64_t datasize = this->readAll(pos, buffer + count, align_down(remaining)); // Straight into the caller's buffer
+            count += datasize;
+
+            if(datasize < align_down(remaining))
+                break;
+
+            continue;
+        }
+
+        uint64_t alignedpos = align_down(pos), skip = pos - alignedpos;
+        uint64_t chunk = std::min<uint64_t>(DIRECT_BOUNCE_SIZE, align_down(skip + remaining + DIRECT_ALIGNMENT - 1));
+        uint64_t datasize = this->readAll(alignedpos, this->_bounce, chunk);
+
+        if(datasize <= skip)
+            break;
+
+        uint64_t n = std::min(datasize - skip, remaining);
+        std::memcpy(buffer + count, this->_bounce + skip, n);
+        count += n;
+
+        if(datasize < chunk)
+            break; // EOF
+    }
+
+    return count;
+}
+
+uint64_t DirectFileIO::readBuffered(uint64_t offset, uint8_t *buffer, uint64_t size)
+{
+    uint64_t count = this->readAll(offset, buffer, size);
+
+    if((offset < this->_dropstart) || (offset > this->_dropend)) // Not contiguous, drop what was collected so far
+    {
+        this->dropPages(true);
+        this->_dropstart = this->_dropend = offset;
+    }
+
+    this->_dropend = std::max(this->_dropend, offset + count);
+    this->dropPages(false);
+    return count;
+}
+
+uint64_t DirectFileIO::readAll(uint64_t offset, uint8_t *buffer, uint64_t size)
+{
+    uint64_t count = 0;
+
+    while(count < size)
+    {
+        ssize_t res = pread(this->_fd, buffer + count, size - count, static_cast<off_t>(offset + count));
+
+        if(res > 0)
+            count += res;
+        else if(!res || (errno != EINTR))
+            break;
+    }
+
+    return count;
+}
+
+void DirectFileIO::dropPages(bool force)
+{
+    if((this->_mode != DropBehind) || (this->_dropend <= this->_dropstart))
+        return;
+
+    if(!force && ((this->_dropend - this->_dropstart) < DROP_BATCH_SIZE))
+        return;
+
+    uint64_t start = align_down(this->_dropstart); // The partial page left by the previous batch
+    posix_fadvise(this->_fd, static_cast<off_t>(start), static_cast<off_t>(this->_dropend - start), POSIX_FADV_DONTNEED);
+    this->_dropstart = this->_dropend;
+}
@@ -0,0 +1,45 @@
+#ifndef DIRECTFILEIO_H
+#define DIRECTFILEIO_H
+
+#include <string>
+#include "../btvmio.h"
+
+/*
+ * BTVMIO for one pass scans that must not fill the page cache.
+ * Direct mode opens the file with O_DIRECT and reads through an aligned bounce
+ * buffer, so template reads can have any offset and size. DropBehind mode (used
+ * when O_DIRECT isn't supported) reads normally and discards the consumed
+ * pages with posix_fadvise(POSIX_FADV_DONTNEED).
+ * The kernel doesn't read ahead for direct reads, enable BTVMIO's readahead.
+ */
+class DirectFileIO: public BTVMIO
+{
+    public:
+        enum Mode { Direct, DropBehind };
+
+    public:
+        DirectFileIO(const std::string& file, Mode mode = Direct);
+        ~DirectFileIO();
+        virtual uint64_t size() const;
+        Mode mode() const;
+
+    protected:
+        virtual uint64_t readData(uint64_t offset, uint8_t* buffer, uint64_t size);
+        virtual void prefetchData(uint64_t offset, uint64_t size);
+        virtual uint64_t findData(uint64_t offset, bool hole);
+
+    private:
+        uint64_t readDirect(uint64_t offset, uint8_t* buffer, uint64_t size);
+        uint64_t readBuffered(uint64_t offset, uint8_t* buffer, uint64_t size);
+        uint64_t readAll(uint64_t offset, uint8_t* buffer, uint64_t size);
+        void dropPages(bool force);
+
+    private:
+        uint8_t* _bounce; // Aligned for O_DIRECT
+        uint64_t _dropstart, _dropend; // Pages read but not dropped yet
+        uint64_t _size;
+        Mode _mode;
+        int _fd;
+};
+
+#endif // DIRECTFILEIO_H
@@ -0,0 +1,265 @@
+#include "inflateio.h"
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <cstdio>
+
+#define INFLATE_CHUNK_SIZE   (64u * 1024u)
+#define INFLATE_SPAN         (1024u * 1024u) // Uncompressed bytes between seek points
+#define INFLATE_WINDOW_SIZE  32768u
+#define INFLATE_AUTO_BITS    (MAX_WBITS + 32) // Detects gzip and zlib headers
+#define INFLATE_INDEX_MAGIC  "BTVMZIX1"
+
+template<typename T> static bool readField(FILE* fp, T& t) { return std::fread(&t, sizeof(T), 1, fp) == 1; }
+template<typename T> static bool writeField(FILE* fp, const T& t) { return std::fwrite(&t, sizeof(T), 1, fp) == 1; }
+
+InflateIO::InflateIO(BTVMIO *source, const std::string &indexfile): BTVMIO(), _source(source), _inoffset(0), _outoffset(0), _size(0), _trailersize(8), _indexing(false), _ended(true), _raw(false)
+{
+    std::memset(&this->_zstream, 0, sizeof(z_stream));
+    this->_input.resize(INFLATE_CHUNK_SIZE);
+
+    uint8_t magic[2] = { 0 };
+
+    if((this->_source->readAt(0, magic, 2) == 2) && ((magic[0] != 0x1F) || (magic[1] != 0x8B)))
+        this->_trailersize = 4; // zlib stream, only an Adler-32 follows the data
+
+    if(inflateInit2(&this->_zstream, INFLATE_AUTO_BITS) != Z_OK)
+        throw std::runtime_error("Cannot initialize zlib");
+
+    if(!indexfile.empty() && this->loadIndex(indexfile))
+        return;
+
+    this->buildIndex();
+
+    if(!indexfile.empty())
+        this->saveIndex(indexfile);
+}
+
+InflateIO::~InflateIO()
+{
+    this->setReadahead(0); // Readahead thread calls readData()
+    inflateEnd(&this->_zstream);
+}
+
+uint64_t InflateIO::size() const
+{
+    return this->_size;
+}
+
+uint64_t InflateIO::readData(uint64_t offset, uint8_t *buffer, uint64_t size)
+{
+    if(offset >= this->_size)
+        return 0;
+
+    const SeekPoint* point = this->findPoint(offset);
+
+    if(this->_ended || (offset < this->_outoffset) || (point && (point->outoffset > this->_outoffset)))
+        this->restart(point); // Going on from the current position is slower otherwise
+
+    uint8_t scratch[INFLATE_CHUNK_SIZE];
+
+    while(!this->_ended && (this->_outoffset < offset))
+        this->decompress(scratch, std::min<uint64_t>(sizeof(scratch), offset - this->_outoffset));
+
+    if(this->_outoffset != offset)
+        return 0;
+
+    return this->decompress(buffer, size);
+}
+
+const InflateIO::SeekPoint *InflateIO::findPoint(uint64_t offset) const
+{
+    auto it = std::upper_bound(this->_index.begin(), this->_index.end(), offset, [](uint64_t o, const SeekPoint& p) { return o < p.outoffset; });
+
+    if(it == this->_index.begin())
+        return NULL;
+
+    return &(*std::prev(it));
+}
+
+bool InflateIO::loadIndex(const std::string &indexfile)
+{
+    FILE* fp = std::fopen(indexfile.c_str(), "rb");
+
+    if(!fp)
+        return false;
+
+    char magic[8] = { 0 };
+    uint64_t insize = 0, count = 0;
+    bool valid = (std::fread(magic, 1, sizeof(magic), fp) == sizeof(magic)) && !std::memcmp(magic, INFLATE_INDEX_MAGIC, sizeof(magic)) &&
+                 readField(fp, insize) && (insize == this->_source->size()) && readField(fp, this->_size) && readField(fp, count);
+
+    for(uint64_t i = 0; valid && (i < count); i++)
+    {
+        SeekPoint point;
+        uint32_t windowsize = 0;
+        valid = readField(fp, point.outoffset) && readField(fp, point.inoffset) && readField(fp, point.bits) && readField(fp, windowsize) && (windowsize <= INFLATE_WINDOW_SIZE);
+
+        if(!valid)
+            break;
+
+        point.window.resize(windowsize);
+        valid = std::fread(point.window.data(), 1, windowsize, fp) == windowsize;
+        this->_index.push_back(std::move(point));
+    }
+
+    std::fclose(fp);
+
+    if(valid)
+        return true;
+
+    this->_index.clear(); // Stale or damaged, build it again
+    this->_size = 0;
+    return false;
+}
+
+void InflateIO::saveIndex(const std::string &indexfile) const
+{
+    FILE* fp = std::fopen(indexfile.c_str(), "wb");
+
+    if(!fp)
+        return; // The index is an optimization only
+
+    std::fwrite(INFLATE_INDEX_MAGIC, 1, 8, fp);
+    writeField(fp, this->_source->size());
+    writeField(fp, this->_size);
+    writeField(fp, static_cast<uint64_t>(this->_index.size()));
+
+    for(const SeekPoint& point : this->_index)
+    {
+        writeField(fp, point.outoffset);
+        writeField(fp, point.inoffset);
+        writeField(fp, point.bits);
+        writeField(fp, static_cast<uint32_t>(point.window.size()));
+        std::fwrite(point.window.data(), 1, point.window.size(), fp);
+    }
+
+    std::fclose(fp);
+}
+
+void InflateIO::buildIndex()
+{
+    uint8_t scratch[INFLATE_CHUNK_SIZE];
+
+    this->_index.clear();
+    this->restart(NULL);
+    this->_indexing = true;
+
+    while(this->decompress(scratch, sizeof(scratch)))
+        continue;
+
+    this->_indexing = false;
+    this->_size = this->_outoffset;
+}
+
+void InflateIO::restart(const SeekPoint *point)
+{
+    inflateReset2(&this->_zstream, point ? -MAX_WBITS : INFLATE_AUTO_BITS);
+    this->_zstream.next_in = NULL;
+    this->_zstream.avail_in = 0;
+    this->_inoffset = point ? point->inoffset : 0;
+    this->_outoffset = point ? point->outoffset : 0;
+    this->_ended = false;
+    this->_raw = (point != NULL);
+
+    if(!point)
+        return;
+
+    if(point->bits)
+    {
+        uint8_t byte = 0;
+        this->_source->readAt(point->inoffset - 1, &byte, 1);
+        inflatePrime(&this->_zstream, static_cast<int>(point->bits), byte >> (8 - point->bits));
+    }
+
+    inflateSetDictionary(&this->_zstream, point->window.data(), static_cast<uInt>(point->window.size()));
+}
+
+uint64_t InflateIO::refill()
+{
+    uint64_t count = this->_source->readAt(this->_inoffset, this->_input.data(), this->_input.size());
+
+    this->_zstream.next_in = this->_input.data();
+    this->_zstream.avail_in = static_cast<uInt>(count);
+    this->_inoffset += count;
+    return count;
+}
+
+bool InflateIO::skipInput(uint64_t count)
+{
+    while(count)
+    {
+        if(!this->_zstream.avail_in && !this->refill())
+            return false;
+
+        uint64_t n = std::min<uint64_t>(count, this->_zstream.avail_in);
+        this->_zstream.next_in += n;
+        this->_zstream.avail_in -= static_cast<uInt>(n);
+        count -= n;
+    }
+
+    return true;
+}
+
+bool InflateIO::nextMember()
+{
+    if(this->_raw && !this->skipInput(this->_trailersize)) // Raw inflate leaves the trailer to us
+        return false;
+
+    if(!this->_zstream.avail_in && !this->refill())
+        return false; // Last member
+
+    inflateReset2(&this->_zstream, INFLATE_AUTO_BITS); // Concatenated gzip members
+    this->_raw = false;
+    return true;
+}
+
+uint64_t InflateIO::decompress(uint8_t *buffer, uint64_t size)
+{
+    uint64_t count = 0;
+
+    while(!this->_ended && (count < size))
+    {
+        if(!this->_zstream.avail_in)
+            this->refill(); // Output can still be pending at the end of input
+
+        uInt availout = static_cast<uInt>(std::min<uint64_t>(size - count, INFLATE_CHUNK_SIZE));
+        this->_zstream.next_out = buffer + count;
+        this->_zstream.avail_out = availout;
+
+        int res = inflate(&this->_zstream, Z_BLOCK);
+        uint64_t produced = availout - this->_zstream.avail_out;
+        count += produced;
+        this->_outoffset += produced;
+
+        if(res == Z_STREAM_END)
+        {
+            this->_ended = !this->nextMember();
+            continue;
+        }
+
+        if((res != Z_OK) && ((res != Z_BUF_ERROR) || !produced))
+        {
+            this->_ended = true; // Truncated or corrupted data, or garbage after the last member
+            break;
+        }
+
+        if(!this->_indexing || !(this->_zstream.data_type & 128) || (this->_zstream.data_type & 64))
+            continue; // Seek points are taken between blocks, but not before the trailer
+
+        if(!this->_index.empty() && ((this->_outoffset - this->_index.back().outoffset) < INFLATE_SPAN))
+            continue;
+
+        SeekPoint point;
+        uInt windowsize = INFLATE_WINDOW_SIZE;
+        point.outoffset = this->_outoffset;
+        point.inoffset = this->_inoffset - this->_zstream.avail_in;
+        point.bits = static_cast<uint32_t>(this->_zstream.data_type & 7);
+        point.window.resize(INFLATE_WINDOW_SIZE);
+        inflateGetDictionary(&this->_zstream, point.window.data(), &windowsize);
+        point.window.resize(windowsize);
+        this->_index.push_back(std::move(point));
+    }
+
+    return count;
+}
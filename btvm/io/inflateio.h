@@ -0,0 +1,59 @@
+#ifndef INFLATEIO_H
+#define INFLATEIO_H
+
+#include <string>
+#include <vector>
+#include <zlib.h>
+#include "../btvmio.h"
+
+/*
+ * BTVMIO decompressing a gzip/zlib compressed BTVMIO on the fly.
+ * A first pass over the input records a seek point every few MiB of output
+ * (position in both streams plus the 32 KiB deflate window), so random reads
+ * only inflate from the nearest point. The index can be saved to a file and
+ * reused by later runs, which then skip the first pass.
+ */
+class InflateIO: public BTVMIO
+{
+    private:
+        struct SeekPoint {
+            uint64_t outoffset; // Uncompressed offset
+            uint64_t inoffset; // First compressed byte to feed
+            uint32_t bits; // Bits of the previous byte still to be fed
+            std::vector<uint8_t> window;
+        };
+
+    public:
+        InflateIO(BTVMIO* source, const std::string& indexfile = std::string()); // 'source' is not deleted
+        ~InflateIO();
+        virtual uint64_t size() const;
+
+    protected:
+        virtual uint64_t readData(uint64_t offset, uint8_t* buffer, uint64_t size);
+
+    private:
+        const SeekPoint* findPoint(uint64_t offset) const;
+        bool loadIndex(const std::string& indexfile);
+        void saveIndex(const std::string& indexfile) const;
+        void buildIndex();
+        void restart(const SeekPoint* point);
+        uint64_t refill();
+        bool skipInput(uint64_t count);
+        bool nextMember();
+        uint64_t decompress(uint8_t* buffer, uint64_t size);
+
+    private:
+        std::vector<SeekPoint> _index;
+        std::vector<uint8_t> _input;
+        z_stream _zstream;
+        BTVMIO* _source;
+        uint64_t _inoffset; // Source offset of the next input chunk
+        uint64_t _outoffset; // Uncompressed offset of the next output byte
+        uint64_t _size;
+        uint32_t _trailersize;
+        bool _indexing;
+        bool _ended;
+        bool _raw; // Restarted from a seek point, headers are not parsed
+};
+
+#endif // INFLATEIO_H
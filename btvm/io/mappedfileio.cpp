@@ -0,0 +1,225 @@
+#include "mappedfileio.h"
+#include <algorithm>
+#include <stdexcept>
+#include <cstdint>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+
+#define MAPPING_WINDOW_SIZE (256u * 1024u * 1024u)
+#define MAPPING_WINDOWS     2 // Unpinned windows kept mapped: the current one and the previous
+
+MappedFileIO::MappedFileIO(const std::string &file, bool writable): BTVMIO(), _mapclock(0), _size(0), _windowed(false), _writefd(-1)
+{
+    this->_fd = open(file.c_str(), O_RDONLY);
+
+    if(this->_fd == -1)
+        throw std::runtime_error("Cannot open '" + file + "'");
+
+    if(writable && ((this->_writefd = open(file.c_str(), O_WRONLY)) == -1))
+    {
+        close(this->_fd);
+        throw std::runtime_error("Cannot open '" + file + "' for writing");
+    }
+
+    struct stat st;
+    off_t size = lseek(this->_fd, 0, SEEK_END); // Works for block devices too
+
+    if(size == -1)
+    {
+        close(this->_fd);
+
+        if(this->_writefd != -1)
+            close(this->_writefd);
+
+        throw std::runtime_error("Cannot seek in '" + file + "', use StreamIO for pipes and sockets");
+    }
+
+    if(size > 0)
+        this->_size = static_cast<uint64_t>(size);
+
+    if(!this->_size || (fstat(this->_fd, &st) == -1) || (!S_ISREG(st.st_mode) && !S_ISBLK(st.st_mode)))
+        return; // Empty or special file, use pread()
+
+    if(this->_size <= SIZE_MAX)
+    {
+        void* mapping = mmap(NULL, static_cast<size_t>(this->_size), PROT_READ, MAP_PRIVATE, this->_fd, 0);
+
+        if(mapping != MAP_FAILED)
+        {
+            Mapping& whole = this->_mappings[0];
+            whole.data = static_cast<uint8_t*>(mapping);
+            whole.size = this->_size;
+            whole.lastuse = 0;
+            whole.pinned = true;
+            madvise(mapping, static_cast<size_t>(this->_size), MADV_SEQUENTIAL);
+            return;
+        }
+    }
+
+    this->_windowed = true; // Address space is too small for the whole file
+}
+
+MappedFileIO::~MappedFileIO()
+{
+    this->setReadahead(0); // Readahead thread calls readData()
+    this->unmap();
+    close(this->_fd);
+
+    if(this->_writefd != -1)
+        close(this->_writefd);
+}
+
+uint64_t MappedFileIO::size() const
+{
+    return this->_size;
+}
+
+const uint8_t *MappedFileIO::mapData(uint64_t offset, uint64_t &size, bool pin)
+{
+    if(offset >= this->_size)
+        return NULL;
+
+    Mappings::iterator it = this->findMapping(offset);
+
+    if((it == this->_mappings.end()) && this->_windowed)
+        it = this->mapWindow(offset);
+
+    if(it == this->_mappings.end())
+        return NULL;
+
+    Mapping& mapping = it->second;
+    mapping.pinned |= pin; // Callers of mapAt() may keep the pointer
+    mapping.lastuse = ++this->_mapclock;
+    size = mapping.size - (offset - it->first);
+    return mapping.data + (offset - it->first);
+}
+
+uint64_t MappedFileIO::readData(uint64_t offset, uint8_t *buffer, uint64_t size)
+{
+    uint64_t count = 0;
+
+    while(count < size)
+    {
+        ssize_t res = pread(this->_fd, buffer + count, size - count, static_cast<off_t>(offset + count));
+
+        if(res > 0)
+            count += res;
+        else if(!res || (errno != EINTR))
+            break;
+    }
+
+    return count;
+}
+
+void MappedFileIO::prefetchData(uint64_t offset, uint64_t size)
+{
+    Mappings::iterator it = this->findMapping(offset);
+
+    if(it == this->_mappings.end())
+    {
+        posix_fadvise(this->_fd, static_cast<off_t>(offset), static_cast<off_t>(size), POSIX_FADV_WILLNEED);
+        BTVMIO::prefetchData(offset, size);
+        return;
+    }
+
+    uint64_t pagesize = static_cast<uint64_t>(sysconf(_SC_PAGESIZE));
+    uint64_t start = offset - (offset % pagesize), end = std::min(offset + size, it->first + it->second.size);
+    madvise(it->second.data + (start - it->first), static_cast<size_t>(end - start), MADV_WILLNEED);
+}
+
+uint64_t MappedFileIO::findData(uint64_t offset, bool hole)
+{
+    return BTVMIO::seekData(this->_fd, offset, hole);
+}
+
+bool MappedFileIO::writable() const
+{
+    return this->_writefd != -1;
+}
+
+uint64_t MappedFileIO::writeData(uint64_t offset, const uint8_t *data, uint64_t size)
+{
+    uint64_t count = 0;
+
+    while(count < size)
+    {
+        ssize_t res = pwrite(this->_writefd, data + count, size - count, static_cast<off_t>(offset + count));
+
+        if(res > 0)
+            count += res;
+        else if(!res || (errno != EINTR))
+            break;
+    }
+
+    return count;
+}
+
+MappedFileIO::Mappings::iterator MappedFileIO::findMapping(uint64_t offset)
+{
+    Mappings::iterator it = this->_mappings.upper_bound(offset);
+
+    if(it == this->_mappings.begin())
+        return this->_mappings.end();
+
+    --it;
+    return (offset < it->first + it->second.size) ? it : this->_mappings.end();
+}
+
+MappedFileIO::Mappings::iterator MappedFileIO::mapWindow(uint64_t offset)
+{
+    uint64_t mapoffset = offset - (offset % MAPPING_WINDOW_SIZE);
+    uint64_t mapsize = std::min<uint64_t>(MAPPING_WINDOW_SIZE, this->_size - mapoffset);
+    this->unmapWindow(MAPPING_WINDOWS - 1);
+
+    void* mapping = mmap(NULL, static_cast<size_t>(mapsize), PROT_READ, MAP_PRIVATE, this->_fd, static_cast<off_t>(mapoffset));
+
+    while((mapping == MAP_FAILED) && this->unmapWindow(1)) // Make room, BTVMIO's window may still use the last one
+        mapping = mmap(NULL, static_cast<size_t>(mapsize), PROT_READ, MAP_PRIVATE, this->_fd, static_cast<off_t>(mapoffset));
+
+    if(mapping == MAP_FAILED)
+        return this->_mappings.end(); // Pinned windows fill the address space, the rest is read with pread()
+
+    madvise(mapping, static_cast<size_t>(mapsize), MADV_SEQUENTIAL);
+
+    Mapping& window = this->_mappings[mapoffset];
+    window.data = static_cast<uint8_t*>(mapping);
+    window.size = mapsize;
+    window.lastuse = 0;
+    window.pinned = false;
+    return this->_mappings.find(mapoffset);
+}
+
+bool MappedFileIO::unmapWindow(size_t keep)
+{
+    Mappings::iterator lru = this->_mappings.end();
+    size_t unpinned = 0;
+
+    for(Mappings::iterator it = this->_mappings.begin(); it != this->_mappings.end(); it++)
+    {
+        if(it->second.pinned)
+            continue;
+
+        unpinned++;
+
+        if((lru == this->_mappings.end()) || (it->second.lastuse < lru->second.lastuse))
+            lru = it;
+    }
+
+    if(unpinned <= keep)
+        return false;
+
+    munmap(lru->second.data, static_cast<size_t>(lru->second.size));
+    this->_mappings.erase(lru);
+    return true;
+}
+
+void MappedFileIO::unmap()
+{
+    for(Mappings::iterator it = this->_mappings.begin(); it != this->_mappings.end(); it++)
+        munmap(it->second.data, static_cast<size_t>(it->second.size));
+
+    this->_mappings.clear();
+}
@@ -0,0 +1,51 @@
+#ifndef MAPPEDFILEIO_H
+#define MAPPEDFILEIO_H
+
+#include <string>
+#include <map>
+#include "../btvmio.h"
+
+/*
+ * BTVMIO over a memory mapped file: reads are served straight from the mapping.
+ * Files that don't fit in the address space are mapped in windows, seekable
+ * special files that can't be mapped are read with pread(). Pipes and sockets
+ * can't be seeked and are rejected: read them with StreamIO.
+ * Windows are aligned to their size: the ones handed out through mapAt() are
+ * pinned until the IO is destroyed (SliceIO/ConcatIO children point into them),
+ * the others are unmapped least recently used first.
+ * Writable files apply committed writes with pwrite(), the mapping sees them.
+ */
+class MappedFileIO: public BTVMIO
+{
+    public:
+        MappedFileIO(const std::string& file, bool writable = false);
+        ~MappedFileIO();
+        virtual uint64_t size() const;
+        virtual bool writable() const;
+
+    protected:
+        virtual const uint8_t* mapData(uint64_t offset, uint64_t& size, bool pin);
+        virtual uint64_t readData(uint64_t offset, uint8_t* buffer, uint64_t size);
+        virtual void prefetchData(uint64_t offset, uint64_t size);
+        virtual uint64_t findData(uint64_t offset, bool hole);
+        virtual uint64_t writeData(uint64_t offset, const uint8_t* data, uint64_t size);
+
+    private:
+        struct Mapping { uint8_t* data; uint64_t size, lastuse; bool pinned; };
+        typedef std::map<uint64_t, Mapping> Mappings; // By file offset, never overlapping
+
+    private:
+        Mappings::iterator findMapping(uint64_t offset);
+        Mappings::iterator mapWindow(uint64_t offset);
+        bool unmapWindow(size_t keep);
+        void unmap();
+
+    private:
+        Mappings _mappings;
+        uint64_t _mapclock;
+        uint64_t _size;
+        bool _windowed;
+        int _fd, _writefd;
+};
+
+#endif // MAPPEDFILEIO_H
@@ -0,0 +1,38 @@
+#include "memoryio.h"
+#include <algorithm>
+#include <cstring>
+
+MemoryIO::MemoryIO(const uint8_t *data, uint64_t size): BTVMIO(), _data(data), _size(data ? size : 0)
+{
+
+}
+
+MemoryIO::~MemoryIO()
+{
+    this->setReadahead(0); // Readahead thread calls readData()
+}
+
+uint64_t MemoryIO::size() const
+{
+    return this->_size;
+}
+
+const uint8_t *MemoryIO::mapData(uint64_t offset, uint64_t &size, bool pin)
+{
+    VMUnused(pin); // The buffer outlives the IO
+    if(offset >= this->_size)
+        return NULL;
+
+    size = this->_size - offset;
+    return this->_data + offset;
+}
+
+uint64_t MemoryIO::readData(uint64_t offset, uint8_t *buffer, uint64_t size)
+{
+    if(offset >= this->_size)
+        return 0;
+
+    uint64_t count = std::min(size, this->_size - offset);
+    std::memcpy(buffer, this->_data + offset, count);
+    return count;
+}
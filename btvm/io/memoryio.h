@@ -0,0 +1,26 @@
+#ifndef MEMORYIO_H
+#define MEMORYIO_H
+
+#include "../btvmio.h"
+
+/*
+ * BTVMIO over a buffer owned by the caller, which must outlive it.
+ * Reads are served straight from the buffer, nothing is copied or cached.
+ */
+class MemoryIO: public BTVMIO
+{
+    public:
+        MemoryIO(const uint8_t* data, uint64_t size);
+        ~MemoryIO();
+        virtual uint64_t size() const;
+
+    protected:
+        virtual const uint8_t* mapData(uint64_t offset, uint64_t& size, bool pin);
+        virtual uint64_t readData(uint64_t offset, uint8_t* buffer, uint64_t size);
+
+    private:
+        const uint8_t* _data;
+        uint64_t _size;
+};
+
+#endif // MEMORYIO_H
@@ -0,0 +1,143 @@
+#include "readahead.h"
+#include <algorithm>
+#include <cstring>
+
+#define SEQUENTIAL_STREAK 2 // Consecutive misses before loading ahead
+
+Readahead::Readahead(uint64_t depth, uint64_t blocksize, const Fetcher &fetcher): _slots(depth), _fetcher(fetcher), _blocksize(blocksize), _nextoffset(UINT64_MAX), _streak(0), _stop(false)
+{
+    for(auto it = this->_slots.begin(); it != this->_slots.end(); it++)
+        it->data.resize(blocksize);
+
+    this->_thread = std::thread(&Readahead::run, this);
+}
+
+Readahead::~Readahead()
+{
+    {
+        std::lock_guard<std::mutex> lock(this->_mutex);
+        this->_stop = true;
+    }
+
+    this->_queued.notify_one();
+    this->_thread.join();
+}
+
+bool Readahead::take(uint64_t offset, uint8_t *data, uint64_t &size)
+{
+    std::unique_lock<std::mutex> lock(this->_mutex);
+    Slot* slot = this->slot(offset);
+
+    if(!slot)
+        return false;
+
+    this->_loaded.wait(lock, [slot]() { return slot->state == Ready; });
+    std::memcpy(data, slot->data.data(), slot->size);
+    size = slot->size;
+    slot->state = Free;
+    return true;
+}
+
+void Readahead::access(uint64_t offset)
+{
+    std::lock_guard<std::mutex> lock(this->_mutex);
+
+    uint64_t first = offset + this->_blocksize, last = offset + (this->_slots.size() * this->_blocksize);
+    this->_streak = (offset == this->_nextoffset) ? (this->_streak + 1) : 0;
+    this->_nextoffset = first;
+
+    for(auto it = this->_slots.begin(); it != this->_slots.end(); it++)
+    {
+        if(it->state == Queued)
+        {
+            if(!this->_streak) // Random access, cancel what wasn't started
+                it->state = Free;
+        }
+        else if((it->state == Ready) && this->_streak && ((it->offset < first) || (it->offset > last)))
+            it->state = Free; // Outside of the current run
+    }
+
+    if(this->_streak + 1 < SEQUENTIAL_STREAK)
+        return;
+
+    for(uint64_t blockoffset = first; blockoffset <= last; blockoffset += this->_blocksize)
+        this->schedule(blockoffset);
+
+    this->_queued.notify_one();
+}
+
+void Readahead::hint(uint64_t offset, uint64_t size)
+{
+    if(!size)
+        return;
+
+    std::lock_guard<std::mutex> lock(this->_mutex);
+
+    uint64_t first = offset - (offset % this->_blocksize), last = offset + size - 1;
+    last = std::min(last - (last % this->_blocksize), first + ((this->_slots.size() - 1) * this->_blocksize));
+
+    for(uint64_t blockoffset = first; blockoffset <= last; blockoffset += this->_blocksize)
+        this->schedule(blockoffset);
+
+    this->_nextoffset = first; // The first miss there continues the run instead of canceling it
+    this->_streak = SEQUENTIAL_STREAK - 1;
+    this->_queued.notify_one();
+}
+
+Readahead::Slot *Readahead::slot(uint64_t offset)
+{
+    for(auto it = this->_slots.begin(); it != this->_slots.end(); it++)
+    {
+        if((it->state != Free) && (it->offset == offset))
+            return &(*it);
+    }
+
+    return NULL;
+}
+
+void Readahead::schedule(uint64_t offset)
+{
+    if(this->slot(offset))
+        return;
+
+    for(auto it = this->_slots.begin(); it != this->_slots.end(); it++)
+    {
+        if(it->state == Free)
+        {
+            it->state = Queued;
+            it->offset = offset;
+            return;
+        }
+    }
+}
+
+void Readahead::run()
+{
+    std::unique_lock<std::mutex> lock(this->_mutex);
+
+    while(!this->_stop)
+    {
+        Slot* slot = NULL;
+
+        for(auto it = this->_slots.begin(); it != this->_slots.end(); it++)
+        {
+            if((it->state == Queued) && (!slot || (it->offset < slot->offset)))
+                slot = &(*it);
+        }
+
+        if(!slot)
+        {
+            this->_queued.wait(lock);
+            continue;
+        }
+
+        slot->state = Loading;
+        lock.unlock();
+        uint64_t size = this->_fetcher(slot->offset, slot->data.data(), slot->data.size());
+        lock.lock();
+
+        slot->size = size;
+        slot->state = Ready;
+        this->_loaded.notify_all();
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef READAHEAD_H
+#define READAHEAD_H
+
+#include <condition_variable>
+#include <functional>
+#include <cstdint>
+#include <thread>
+#include <vector>
+#include <mutex>
+
+/*
+ * Background loader for the blocks following a sequential run of cache misses.
+ * Random access cancels queued blocks, so readahead backs off on its own.
+ */
+class Readahead
+{
+    public:
+        typedef std::function<uint64_t(uint64_t, uint8_t*, uint64_t)> Fetcher;
+
+    private:
+        enum SlotState { Free, Queued, Loading, Ready };
+
+        struct Slot {
+            Slot(): state(Free), offset(0), size(0) { }
+            SlotState state;
+            uint64_t offset;
+            uint64_t size;
+            std::vector<uint8_t> data;
+        };
+
+    public:
+        Readahead(uint64_t depth, uint64_t blocksize, const Fetcher& fetcher);
+        ~Readahead();
+        bool take(uint64_t offset, uint8_t* data, uint64_t& size);
+        void access(uint64_t offset);
+        void hint(uint64_t offset, uint64_t size); // A sequential run is about to start at 'offset'
+
+    private:
+        Slot* slot(uint64_t offset);
+        void schedule(uint64_t offset);
+        void run();
+
+    private:
+        std::vector<Slot> _slots;
+        std::condition_variable _queued;
+        std::condition_variable _loaded;
+        std::mutex _mutex;
+        std::thread _thread;
+        Fetcher _fetcher;
+        uint64_t _blocksize;
+        uint64_t _nextoffset;
+        uint64_t _streak;
+        bool _stop;
+};
+
+#endif // READAHEAD_H
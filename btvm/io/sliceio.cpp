@@ -0,0 +1,74 @@
+#include "sliceio.h"
+#include <algorithm>
+
+SliceIO::SliceIO(BTVMIO *parent, uint64_t offset, uint64_t size): BTVMIO(), _parent(parent), _offset(std::min(offset, parent->size())), _size(0)
+{
+    this->_size = std::min(size, this->_parent->size() - this->_offset);
+}
+
+SliceIO::~SliceIO()
+{
+    this->setReadahead(0); // Readahead thread calls readData()
+}
+
+uint64_t SliceIO::size() const
+{
+    return this->_size;
+}
+
+const uint8_t *SliceIO::mapData(uint64_t offset, uint64_t &size, bool pin)
+{
+    VMUnused(pin); // mapAt() pins the parent's data, our window may point there for a while
+    if(offset >= this->_size)
+        return NULL;
+
+    const uint8_t* data = this->_parent->mapAt(this->_offset + offset, size);
+
+    if(data)
+        size = std::min(size, this->_size - offset); // The window ends with the slice
+
+    return data;
+}
+
+uint64_t SliceIO::readData(uint64_t offset, uint8_t *buffer, uint64_t size)
+{
+    if(offset >= this->_size)
+        return 0;
+
+    return this->_parent->readAt(this->_offset + offset, buffer, std::min(size, this->_size - offset));
+}
+
+bool SliceIO::writable() const
+{
+    return this->_parent->writable();
+}
+
+uint64_t SliceIO::writeData(uint64_t offset, const uint8_t *data, uint64_t size)
+{
+    if((offset >= this->_size) || !this->_parent->writeAt(this->_offset + offset, data, std::min(size, this->_size - offset)))
+        return 0;
+
+    return std::min(size, this->_size - offset);
+}
+
+void SliceIO::prefetchData(uint64_t offset, uint64_t size)
+{
+    this->_parent->prefetch(this->_offset + offset, size);
+    BTVMIO::prefetchData(offset, size); // Our own cache, when the parent isn't mapped
+}
+
+uint64_t SliceIO::findData(uint64_t offset, bool hole)
+{
+    uint64_t end;
+
+    for( ; offset < this->_size; offset = end - this->_offset)
+    {
+        if(this->_parent->holeAt(this->_offset + offset, end) == hole)
+            return offset;
+
+        if(end >= this->_offset + this->_size)
+            break;
+    }
+
+    return UINT64_MAX;
+}
@@ -0,0 +1,32 @@
+#ifndef SLICEIO_H
+#define SLICEIO_H
+
+#include "../btvmio.h"
+
+/*
+ * BTVMIO viewing the [offset, offset + size) range of another BTVMIO, for
+ * formats embedded in containers. Mapped parents are read in place, the others
+ * through readAt(), so the parent's cursor never moves and nothing is extracted.
+ */
+class SliceIO: public BTVMIO
+{
+    public:
+        SliceIO(BTVMIO* parent, uint64_t offset, uint64_t size); // 'parent' is not deleted, the range is clipped to its size
+        ~SliceIO();
+        virtual uint64_t size() const;
+        virtual bool writable() const;
+
+    protected:
+        virtual const uint8_t* mapData(uint64_t offset, uint64_t& size, bool pin);
+        virtual uint64_t readData(uint64_t offset, uint8_t* buffer, uint64_t size);
+        virtual void prefetchData(uint64_t offset, uint64_t size);
+        virtual uint64_t findData(uint64_t offset, bool hole);
+        virtual uint64_t writeData(uint64_t offset, const uint8_t* data, uint64_t size); // Queued in the parent, committed with it
+
+    private:
+        BTVMIO* _parent;
+        uint64_t _offset;
+        uint64_t _size;
+};
+
+#endif // SLICEIO_H
@@ -0,0 +1,100 @@
+#include "streamio.h"
+#include <algorithm>
+#include <cstring>
+#include <unistd.h>
+#include <poll.h>
+#include <cerrno>
+
+#define STREAM_CHUNK_SIZE (64u * 1024u)
+
+StreamIO::StreamIO(int fd, uint64_t window): BTVMIO(), _bufferoffset(0), _served(0), _window(window), _ended(false), _fd(fd)
+{
+
+}
+
+StreamIO::~StreamIO()
+{
+    this->setReadahead(0); // Readahead thread calls readData()
+}
+
+bool StreamIO::seekable(uint64_t offset)
+{
+    this->pull(offset + 1); // Forward seeks wait for their data
+    return offset >= this->windowStart();
+}
+
+uint64_t StreamIO::size() const
+{
+    return this->received();
+}
+
+uint64_t StreamIO::windowStart() const
+{
+    return (this->_served > this->_window) ? (this->_served - this->_window) : 0;
+}
+
+uint64_t StreamIO::readData(uint64_t offset, uint8_t *buffer, uint64_t size)
+{
+    uint64_t count = 0;
+
+    while(count < size) // Copy while pulling, large reads may not fit in the window
+    {
+        uint64_t position = offset + count;
+        this->pull(position + 1);
+
+        if((position < this->_bufferoffset) || (position >= this->received()))
+            break; // Discarded, or past the end of input
+
+        uint64_t span = std::min(size - count, this->received() - position);
+        std::memcpy(buffer + count, this->_buffer.data() + (position - this->_bufferoffset), span);
+        count += span;
+    }
+
+    this->_served = std::max(this->_served, offset + count);
+    return count;
+}
+
+uint64_t StreamIO::received() const
+{
+    return this->_bufferoffset + this->_buffer.size();
+}
+
+void StreamIO::pull(uint64_t offset)
+{
+    while(!this->_ended && (this->received() < offset))
+    {
+        this->discard();
+
+        uint64_t size = this->_buffer.size();
+        this->_buffer.resize(size + STREAM_CHUNK_SIZE);
+        ssize_t res = ::read(this->_fd, this->_buffer.data() + size, STREAM_CHUNK_SIZE);
+        this->_buffer.resize(size + std::max<ssize_t>(res, 0));
+
+        if((res < 0) && ((errno == EAGAIN) || (errno == EWOULDBLOCK)))
+        {
+            struct pollfd pfd = { this->_fd, POLLIN, 0 };
+            poll(&pfd, 1, -1); // Non-blocking fd: wait for data instead of spinning, hangups end the next read()
+            continue;
+        }
+
+        if(!res || ((res < 0) && (errno != EINTR)))
+            this->_ended = true;
+    }
+}
+
+void StreamIO::discard()
+{
+    uint64_t keepoffset = this->windowStart();
+    keepoffset -= keepoffset % this->blockSize(); // Whole cache blocks are read
+
+    if(keepoffset <= this->_bufferoffset)
+        return;
+
+    uint64_t count = keepoffset - this->_bufferoffset;
+
+    if(count < std::max<uint64_t>(this->_window, STREAM_CHUNK_SIZE)) // Amortize the move
+        return;
+
+    this->_buffer.erase(this->_buffer.begin(), this->_buffer.begin() + count);
+    this->_bufferoffset = keepoffset;
+}
@@ -0,0 +1,41 @@
+#ifndef STREAMIO_H
+#define STREAMIO_H
+
+#include <vector>
+#include "../btvmio.h"
+
+/*
+ * BTVMIO over a non seekable input (pipes, sockets, stdin).
+ * Input is read on demand and only the 'window' bytes before the furthest read
+ * are kept: templates can seek backwards and look ahead as long as they stay
+ * within that window.
+ * size() is the amount of input received so far and grows while reading.
+ * Readahead must stay disabled, input is pulled by the VM's thread.
+ */
+class StreamIO: public BTVMIO
+{
+    public:
+        StreamIO(int fd, uint64_t window); // 'fd' is not closed
+        ~StreamIO();
+        virtual bool seekable(uint64_t offset);
+        virtual uint64_t size() const;
+        uint64_t windowStart() const;
+
+    protected:
+        virtual uint64_t readData(uint64_t offset, uint8_t* buffer, uint64_t size);
+
+    private:
+        uint64_t received() const;
+        void pull(uint64_t offset);
+        void discard();
+
+    private:
+        std::vector<uint8_t> _buffer;
+        uint64_t _bufferoffset; // Stream offset of _buffer[0]
+        uint64_t _served; // End of the furthest read, the window ends here
+        uint64_t _window;
+        bool _ended;
+        int _fd;
+};
+
+#endif // STREAMIO_H
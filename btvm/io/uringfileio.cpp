@@ -0,0 +1,38 @@
+#include "uringfileio.h"
+#include <stdexcept>
+#include <fcntl.h>
+
+URingFileIO::URingFileIO(const std::string &file, URingQueue *queue): BTVMIO(), _queue(queue ? queue : URingQueue::shared()), _size(0)
+{
+    this->_fd = this->_queue->open(file, this->_size);
+
+    if(this->_fd == -1)
+        throw std::runtime_error("Cannot open '" + file + "'");
+}
+
+URingFileIO::~URingFileIO()
+{
+    this->setReadahead(0); // Readahead thread calls readData()
+    this->_queue->close(this->_fd);
+}
+
+uint64_t URingFileIO::size() const
+{
+    return this->_size;
+}
+
+uint64_t URingFileIO::readData(uint64_t offset, uint8_t *buffer, uint64_t size)
+{
+    return this->_queue->read(this->_fd, offset, buffer, size);
+}
+
+void URingFileIO::prefetchData(uint64_t offset, uint64_t size)
+{
+    posix_fadvise(this->_fd, static_cast<off_t>(offset), static_cast<off_t>(size), POSIX_FADV_WILLNEED);
+    BTVMIO::prefetchData(offset, size);
+}
+
+uint64_t URingFileIO::findData(uint64_t offset, bool hole)
+{
+    return BTVMIO::seekData(this->_fd, offset, hole);
+}
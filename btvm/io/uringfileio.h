@@ -0,0 +1,33 @@
+#ifndef URINGFILEIO_H
+#define URINGFILEIO_H
+
+#include <string>
+#include "../btvmio.h"
+#include "uringqueue.h"
+
+/*
+ * BTVMIO over a file opened and read through io_uring.
+ * IOs sharing the same URingQueue batch their submissions and completions,
+ * which pays off when many small files are parsed by concurrent VMs.
+ * It is opt-in: on hosts with few cores or fast storage the buffered and
+ * mapped backends are faster, tools/uringbench.cpp compares them.
+ */
+class URingFileIO: public BTVMIO
+{
+    public:
+        URingFileIO(const std::string& file, URingQueue* queue = NULL); // NULL uses URingQueue::shared()
+        ~URingFileIO();
+        virtual uint64_t size() const;
+
+    protected:
+        virtual uint64_t readData(uint64_t offset, uint8_t* buffer, uint64_t size);
+        virtual void prefetchData(uint64_t offset, uint64_t size);
+        virtual uint64_t findData(uint64_t offset, bool hole);
+
+    private:
+        URingQueue* _queue;
+        uint64_t _size;
+        int _fd;
+};
+
+#endif // URINGFILEIO_H
@@ -0,0 +1,343 @@
+#include "uringqueue.h"
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <vector>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <cerrno>
+
+#define URING_QUEUE_ENTRIES 256
+#define URING_MAX_READ      (1u << 30) // Completions report 32 bit results
+
+URingQueue::URingQueue(uint32_t entries): _sqring(NULL), _cqring(NULL), _sqes(NULL), _cqes(NULL), _sqringsize(0), _cqringsize(0), _entries(0), _pending(0), _inflight(0), _waiting(false), _fd(-1)
+{
+    std::fill(this->_opcodes, this->_opcodes + IORING_OP_LAST, 0);
+
+    if(!this->setup(entries))
+        this->release(); // Plain syscalls will be used
+}
+
+URingQueue::~URingQueue()
+{
+    this->release();
+}
+
+bool URingQueue::available() const
+{
+    return this->_fd != -1;
+}
+
+int URingQueue::open(const std::string &file, uint64_t &size)
+{
+    Request request;
+    std::unique_lock<std::mutex> lock(this->_mutex);
+    io_uring_sqe* sqe = this->prepare(IORING_OP_OPENAT, &request);
+    int fd;
+
+    if(sqe)
+    {
+        sqe->fd = AT_FDCWD;
+        sqe->addr = reinterpret_cast<uint64_t>(file.c_str());
+        sqe->open_flags = O_RDONLY | O_CLOEXEC;
+        this->queue();
+
+        fd = this->execute(lock, &request);
+        lock.unlock();
+    }
+    else
+    {
+        lock.unlock();
+        fd = ::open(file.c_str(), O_RDONLY | O_CLOEXEC);
+    }
+
+    if(fd < 0)
+        return -1;
+
+    off_t end = lseek(fd, 0, SEEK_END); // IORING_OP_STATX always runs in a kernel worker, this is cheaper
+    size = (end > 0) ? static_cast<uint64_t>(end) : 0;
+    return fd;
+}
+
+uint64_t URingQueue::read(int fd, uint64_t offset, uint8_t *buffer, uint64_t size)
+{
+    uint64_t count = 0;
+
+    while(count < size)
+    {
+        Request request;
+        uint64_t chunk = std::min<uint64_t>(size - count, URING_MAX_READ);
+        std::unique_lock<std::mutex> lock(this->_mutex);
+        io_uring_sqe* sqe = this->prepare(IORING_OP_READ, &request);
+        int64_t res;
+
+        if(sqe)
+        {
+            sqe->fd = fd;
+            sqe->addr = reinterpret_cast<uint64_t>(buffer + count);
+            sqe->len = static_cast<uint32_t>(chunk);
+            sqe->off = offset + count;
+            this->queue();
+
+            res = this->execute(lock, &request);
+
+            if(res < 0)
+                errno = static_cast<int>(-res);
+        }
+        else
+        {
+            lock.unlock();
+            res = pread(fd, buffer + count, chunk, static_cast<off_t>(offset + count));
+        }
+
+        if(res > 0)
+            count += res;
+        else if(!res || ((errno != EINTR) && (errno != EAGAIN)))
+            break;
+    }
+
+    return count;
+}
+
+void URingQueue::close(int fd)
+{
+    std::unique_lock<std::mutex> lock(this->_mutex);
+    io_uring_sqe* sqe = this->prepare(IORING_OP_CLOSE, NULL);
+
+    if(!sqe)
+    {
+        lock.unlock();
+        ::close(fd);
+        return;
+    }
+
+    sqe->fd = fd;
+    this->queue();
+    this->submit(this->_pending, 0); // Nobody waits for it
+    this->_pending = 0;
+}
+
+URingQueue *URingQueue::shared()
+{
+    static URingQueue queue(URING_QUEUE_ENTRIES);
+    return &queue;
+}
+
+bool URingQueue::setup(uint32_t entries)
+{
+    io_uring_params params;
+    std::memset(&params, 0, sizeof(io_uring_params));
+
+    this->_fd = static_cast<int>(syscall(__NR_io_uring_setup, entries, &params));
+
+    if(this->_fd < 0)
+    {
+        this->_fd = -1; // ENOSYS, or disabled by the system
+        return false;
+    }
+
+    this->_entries = params.sq_entries;
+    this->_sqringsize = params.sq_off.array + (params.sq_entries * sizeof(uint32_t));
+    this->_cqringsize = params.cq_off.cqes + (params.cq_entries * sizeof(io_uring_cqe));
+
+    if(params.features & IORING_FEAT_SINGLE_MMAP)
+        this->_sqringsize = this->_cqringsize = std::max(this->_sqringsize, this->_cqringsize);
+
+    void* sqring = mmap(NULL, static_cast<size_t>(this->_sqringsize), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->_fd, IORING_OFF_SQ_RING);
+
+    if(sqring == MAP_FAILED)
+        return false;
+
+    this->_sqring = static_cast<uint8_t*>(sqring);
+
+    if(params.features & IORING_FEAT_SINGLE_MMAP)
+        this->_cqring = this->_sqring;
+    else
+    {
+        void* cqring = mmap(NULL, static_cast<size_t>(this->_cqringsize), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->_fd, IORING_OFF_CQ_RING);
+
+        if(cqring == MAP_FAILED)
+            return false;
+
+        this->_cqring = static_cast<uint8_t*>(cqring);
+    }
+
+    void* sqes = mmap(NULL, this->_entries * sizeof(io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, this->_fd, IORING_OFF_SQES);
+
+    if(sqes == MAP_FAILED)
+        return false;
+
+    this->_sqes = static_cast<io_uring_sqe*>(sqes);
+    this->_sqhead = reinterpret_cast<uint32_t*>(this->_sqring + params.sq_off.head);
+    this->_sqtail = reinterpret_cast<uint32_t*>(this->_sqring + params.sq_off.tail);
+    this->_sqmask = reinterpret_cast<uint32_t*>(this->_sqring + params.sq_off.ring_mask);
+    this->_cqhead = reinterpret_cast<uint32_t*>(this->_cqring + params.cq_off.head);
+    this->_cqtail = reinterpret_cast<uint32_t*>(this->_cqring + params.cq_off.tail);
+    this->_cqmask = reinterpret_cast<uint32_t*>(this->_cqring + params.cq_off.ring_mask);
+    this->_cqes = reinterpret_cast<io_uring_cqe*>(this->_cqring + params.cq_off.cqes);
+
+    uint32_t* sqarray = reinterpret_cast<uint32_t*>(this->_sqring + params.sq_off.array);
+
+    for(uint32_t i = 0; i < this->_entries; i++) // SQEs are used in ring order
+        sqarray[i] = i;
+
+    std::vector<uint8_t> probebuffer(sizeof(io_uring_probe) + (IORING_OP_LAST * sizeof(io_uring_probe_op)), 0);
+    io_uring_probe* probe = reinterpret_cast<io_uring_probe*>(probebuffer.data());
+
+    if(syscall(__NR_io_uring_register, this->_fd, IORING_REGISTER_PROBE, probe, IORING_OP_LAST) < 0)
+        return false; // Kernels without probing don't have the opcodes we need
+
+    for(uint32_t i = 0; (i < probe->ops_len) && (i < IORING_OP_LAST); i++)
+        this->_opcodes[i] = probe->ops[i].flags & IO_URING_OP_SUPPORTED;
+
+    uint32_t maxworkers[2] = { this->_entries, this->_entries }; // Blocking opens and reads run in kernel workers, one per request at most
+    syscall(__NR_io_uring_register, this->_fd, IORING_REGISTER_IOWQ_MAX_WORKERS, maxworkers, 2);
+
+    return true;
+}
+
+void URingQueue::release()
+{
+    if(this->_sqes)
+        munmap(this->_sqes, this->_entries * sizeof(io_uring_sqe));
+
+    if(this->_cqring && (this->_cqring != this->_sqring))
+        munmap(this->_cqring, static_cast<size_t>(this->_cqringsize));
+
+    if(this->_sqring)
+        munmap(this->_sqring, static_cast<size_t>(this->_sqringsize));
+
+    if(this->_fd != -1)
+        ::close(this->_fd); // Pending requests are completed or canceled by the kernel
+
+    this->_sqring = this->_cqring = NULL;
+    this->_sqes = NULL;
+    this->_fd = -1;
+}
+
+bool URingQueue::supports(uint8_t opcode) const
+{
+    return this->_opcodes[opcode];
+}
+
+io_uring_sqe *URingQueue::prepare(uint8_t opcode, Request *request)
+{
+    if(!this->available() || !this->supports(opcode))
+        return NULL;
+
+    this->reap();
+
+    if(this->_inflight >= this->_entries) // Ring is saturated
+        return NULL;
+
+    io_uring_sqe* sqe = &this->_sqes[*this->_sqtail & *this->_sqmask];
+    std::memset(sqe, 0, sizeof(io_uring_sqe));
+    sqe->opcode = opcode;
+    sqe->user_data = reinterpret_cast<uint64_t>(request);
+    return sqe;
+}
+
+void URingQueue::queue()
+{
+    __atomic_store_n(this->_sqtail, *this->_sqtail + 1, __ATOMIC_RELEASE);
+    this->_pending++;
+    this->_inflight++;
+}
+
+int32_t URingQueue::execute(std::unique_lock<std::mutex> &lock, Request *request)
+{
+    while(!request->done)
+    {
+        this->reap();
+
+        if(request->done)
+            break;
+
+        if(this->_waiting)
+        {
+            if(this->_pending) // The waiting thread has already entered the kernel
+            {
+                this->submit(this->_pending, 0);
+                this->_pending = 0;
+            }
+
+            request->sleeping = true;
+            this->_sleepers.push_back(request);
+            request->wakeup.wait(lock);
+            this->_sleepers.erase(std::find(this->_sleepers.begin(), this->_sleepers.end(), request));
+            request->sleeping = false;
+            continue;
+        }
+
+        uint32_t pending = this->_pending;
+        this->_pending = 0;
+        this->_waiting = true;
+
+        lock.unlock();
+        this->submit(pending, 1);
+        lock.lock();
+
+        this->_waiting = false;
+    }
+
+    if(!this->_waiting) // Hand waiting over to a thread whose request is still running
+    {
+        for(Request* sleeper : this->_sleepers)
+        {
+            if(sleeper->done)
+                continue;
+
+            sleeper->wakeup.notify_one();
+            break;
+        }
+    }
+
+    return request->result;
+}
+
+void URingQueue::submit(uint32_t count, uint32_t mincomplete)
+{
+    unsigned int flags = mincomplete ? IORING_ENTER_GETEVENTS : 0;
+
+    for(;;)
+    {
+        long res = syscall(__NR_io_uring_enter, this->_fd, count, mincomplete, flags, NULL, 0);
+
+        if(res >= 0)
+        {
+            if(static_cast<uint32_t>(res) >= count)
+                return; // Waiting may have been interrupted, callers check their requests again
+
+            count -= static_cast<uint32_t>(res);
+        }
+        else if((errno != EINTR) && (errno != EAGAIN) && (errno != EBUSY))
+            throw std::runtime_error("io_uring_enter() failed: " + std::string(strerror(errno)));
+    }
+}
+
+void URingQueue::reap()
+{
+    uint32_t head = *this->_cqhead;
+    uint32_t tail = __atomic_load_n(this->_cqtail, __ATOMIC_ACQUIRE);
+
+    for( ; head != tail; head++)
+    {
+        const io_uring_cqe& cqe = this->_cqes[head & *this->_cqmask];
+        Request* request = reinterpret_cast<Request*>(cqe.user_data);
+
+        if(request)
+        {
+            request->result = cqe.res;
+            request->done = true;
+
+            if(request->sleeping)
+                request->wakeup.notify_one();
+        }
+
+        this->_inflight--;
+    }
+
+    __atomic_store_n(this->_cqhead, head, __ATOMIC_RELEASE);
+}
@@ -0,0 +1,69 @@
+#ifndef URINGQUEUE_H
+#define URINGQUEUE_H
+
+#include <condition_variable>
+#include <linux/io_uring.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <mutex>
+
+/*
+ * io_uring instance shared by many concurrent BTVMIOs.
+ * Callers block until their own request completes: one waiter at a time submits
+ * everything queued so far and reaps completions on behalf of all threads,
+ * waking up only the threads whose requests are done.
+ * Operations fall back to plain syscalls when io_uring (or one of its opcodes)
+ * is not available in the running kernel.
+ */
+class URingQueue
+{
+    private:
+        struct Request {
+            Request(): result(0), done(false), sleeping(false) { }
+            std::condition_variable wakeup;
+            int32_t result;
+            bool done;
+            bool sleeping;
+        };
+
+    public:
+        URingQueue(uint32_t entries);
+        ~URingQueue();
+        bool available() const;
+        int open(const std::string& file, uint64_t& size);
+        uint64_t read(int fd, uint64_t offset, uint8_t* buffer, uint64_t size);
+        void close(int fd);
+
+    public:
+        static URingQueue* shared();
+
+    private:
+        bool setup(uint32_t entries);
+        void release();
+        bool supports(uint8_t opcode) const;
+        io_uring_sqe* prepare(uint8_t opcode, Request* request);
+        void queue();
+        int32_t execute(std::unique_lock<std::mutex>& lock, Request* request);
+        void submit(uint32_t count, uint32_t mincomplete);
+        void reap();
+
+    private:
+        std::vector<Request*> _sleepers; // Threads waiting for another one to reap their completions
+        std::mutex _mutex;
+        uint8_t _opcodes[IORING_OP_LAST];
+        uint8_t* _sqring;
+        uint8_t* _cqring;
+        io_uring_sqe* _sqes;
+        io_uring_cqe* _cqes;
+        uint32_t *_sqhead, *_sqtail, *_sqmask;
+        uint32_t *_cqhead, *_cqtail, *_cqmask;
+        uint64_t _sqringsize, _cqringsize;
+        uint32_t _entries;
+        uint32_t _pending; // Queued, not submitted yet
+        uint32_t _inflight; // Queued or submitted, not reaped yet
+        bool _waiting; // A thread is waiting for completions in the kernel
+        int _fd;
+};
+
+#endif // URINGQUEUE_H
@@ -0,0 +1,102 @@
+#include "writejournal.h"
+#include <algorithm>
+#include <cstring>
+
+WriteJournal::WriteJournal()
+{
+
+}
+
+bool WriteJournal::empty() const
+{
+    return this->_extents.empty();
+}
+
+uint64_t WriteJournal::extents() const
+{
+    return this->_extents.size();
+}
+
+void WriteJournal::write(uint64_t offset, const uint8_t *data, uint64_t size)
+{
+    if(!size)
+        return;
+
+    uint64_t start = offset, end = offset + size;
+    auto first = this->_extents.upper_bound(offset);
+
+    if((first != this->_extents.begin()) && ((std::prev(first)->first + std::prev(first)->second.size()) >= offset))
+        first--; // Overlapping or adjacent to the previous extent
+
+    auto last = first;
+
+    for( ; (last != this->_extents.end()) && (last->first <= end); last++)
+    {
+        start = std::min(start, last->first);
+        end = std::max<uint64_t>(end, last->first + last->second.size());
+    }
+
+    if((first != last) && (first->first == start) && (std::next(first) == last)) // Extended in place, sequential patches stay linear
+    {
+        std::vector<uint8_t>& extent = first->second;
+        extent.resize(end - start);
+        std::memcpy(extent.data() + (offset - start), data, size);
+        return;
+    }
+
+    std::vector<uint8_t> merged(end - start);
+
+    for(auto it = first; it != last; it++)
+        std::memcpy(merged.data() + (it->first - start), it->second.data(), it->second.size());
+
+    std::memcpy(merged.data() + (offset - start), data, size);
+    this->_extents.erase(first, last);
+    this->_extents.emplace(start, std::move(merged));
+}
+
+void WriteJournal::overlay(uint64_t offset, uint8_t *buffer, uint64_t size) const
+{
+    uint64_t end = offset + size;
+    auto it = this->_extents.upper_bound(offset);
+
+    if(it != this->_extents.begin())
+        it--;
+
+    for( ; (it != this->_extents.end()) && (it->first < end); it++)
+    {
+        uint64_t start = std::max(offset, it->first), stop = std::min<uint64_t>(end, it->first + it->second.size());
+
+        if(start < stop)
+            std::memcpy(buffer + (start - offset), it->second.data() + (start - it->first), stop - start);
+    }
+}
+
+uint64_t WriteJournal::nextWrite(uint64_t offset) const
+{
+    auto it = this->_extents.upper_bound(offset);
+
+    if((it != this->_extents.begin()) && ((std::prev(it)->first + std::prev(it)->second.size()) > offset))
+        return std::prev(it)->first;
+
+    return (it != this->_extents.end()) ? it->first : UINT64_MAX;
+}
+
+bool WriteJournal::apply(const Writer &writer)
+{
+    while(!this->_extents.empty())
+    {
+        auto it = this->_extents.begin();
+
+        if(writer(it->first, it->second.data(), it->second.size()) != it->second.size())
+            return false;
+
+        this->_extents.erase(it);
+    }
+
+    return true;
+}
+
+void WriteJournal::clear()
+{
+    this->_extents.clear();
+}
@@ -0,0 +1,36 @@
+#ifndef WRITEJOURNAL_H
+#define WRITEJOURNAL_H
+
+#include <functional>
+#include <cstdint>
+#include <vector>
+#include <map>
+
+/*
+ * Writes waiting to be applied to an input, kept as sorted extents.
+ * Overlapping and adjacent writes are coalesced as they arrive (later data
+ * wins), so applying them is one pass of large, ordered writes.
+ */
+class WriteJournal
+{
+    public:
+        typedef std::function<uint64_t(uint64_t, const uint8_t*, uint64_t)> Writer; // Offset, data, size: returns the bytes written
+
+    public:
+        WriteJournal();
+        bool empty() const;
+        uint64_t extents() const;
+        void write(uint64_t offset, const uint8_t* data, uint64_t size);
+        void overlay(uint64_t offset, uint8_t* buffer, uint64_t size) const; // Copies pending data over [offset, offset + size)
+        uint64_t nextWrite(uint64_t offset) const; // Start of the first extent ending after 'offset', UINT64_MAX if none
+        bool apply(const Writer& writer); // Applied extents are removed, false if one was written partially
+        void clear();
+
+    private:
+        typedef std::map<uint64_t, std::vector<uint8_t> > ExtentMap;
+
+    private:
+        ExtentMap _extents; // By offset, never overlapping nor adjacent
+};
+
+#endif // WRITEJOURNAL_H
@@ -5,6 +5,18 @@ using namespace std;
 
 unsigned long long Node::global_id = 0;
 
+void *Node::operator new(size_t size)
+{
+    VMMemory::allocated(VMMemoryCategory::Nodes, size);
+    return ::operator new(size);
+}
+
+void Node::operator delete(void *p, size_t size)
+{
+    VMMemory::released(VMMemoryCategory::Nodes, size);
+    ::operator delete(p);
+}
+
 #define dump_object_name __xml_dump__
 #define create_dump_object(n) XMLNode dump_object_name(node_typename(n));
 #define return_dump_object return dump_object_name
@@ -7,6 +7,7 @@
 #include <string>
 #include <vector>
 #include "vmvalue.h"
+#include "vmmemory.h"
 
 class VM;
 struct Node;
@@ -33,6 +34,8 @@ struct Node
     Node() { }
     virtual ~Node() { }
     virtual std::string __type__() const = 0;
+    static void* operator new(size_t size);
+    static void operator delete(void* p, size_t size); // Out of line, GCC flags inlined class new paired with global delete
 
     protected:
         static unsigned long long global_id;
@@ -89,9 +92,10 @@ struct NIdentifier: public Node
 {
     AST_NODE(NIdentifier)
 
-    NIdentifier(const std::string& value): Node(), value(value) { }
+    NIdentifier(const std::string& value): Node(), value(value), symbol(VMSymbolTable::current()->intern(value)) { }
 
     std::string value;
+    VMSymbol symbol;
 };
 
 struct NEnumValue: public Node
@@ -33,12 +33,18 @@ VMValuePtr VM::execute(const string &file)
 
 VMValuePtr VM::evaluate(const string &code)
 {
+    MemoryContext(&this->memory);
     this->parse(code);
 
     if(!this->_ast || (this->state == VMState::Error))
         return VMValuePtr();
 
-    return this->interpret(this->_ast);
+    VMValuePtr vmvalue = this->interpret(this->_ast);
+
+    if(this->state != VMState::Error)
+        this->commitValues();
+
+    return vmvalue;
 }
 
 void VM::parse(const string &code)
@@ -48,9 +54,25 @@ void VM::parse(const string &code)
 
     this->state = VMState::NoState;
     this->allocations.clear();
+    this->memory.reset();
     VMUnused(code);
 }
 
+const string &VM::symbolName(VMSymbol symbol) const
+{
+    return this->symbols.name(symbol);
+}
+
+const VMMemoryStats &VM::memoryStats() const
+{
+    return this->memory;
+}
+
+void VM::setMemoryAttribution(bool b)
+{
+    this->memory.attribute = b;
+}
+
 void VM::dump(const string &file, const string &astfile)
 {
     this->parse(this->readFile(file));
@@ -166,7 +188,7 @@ VMValuePtr VM::interpret(NFor *nfor)
 
 VMValuePtr VM::interpret(NSwitch *nswitch)
 {
-    VMCaseMap casemap = this->buildCaseMap(nswitch);
+    const VMCaseMap& casemap = this->buildCaseMap(nswitch);
     auto itcond = casemap.find(*this->interpret(nswitch->expression));
 
     if(itcond == casemap.end())
@@ -221,11 +243,20 @@ VMValuePtr VM::interpret(NUnaryOperator *nunary)
     if(!btv->is_scalar())
         return this->error("Cannot use unary operators on '" + btv->type_name() + "' types");
 
-    if(nunary->op == "++")
-        return nunary->is_prefix ? VMValue::copy_value(++(*btv)) : VMValue::copy_value((*btv)++);
+    if((nunary->op == "++") || (nunary->op == "--"))
+    {
+        VMValuePtr vmvalue;
+
+        if(nunary->op == "++")
+            vmvalue = nunary->is_prefix ? VMValue::copy_value(++(*btv)) : VMValue::copy_value((*btv)++);
+        else
+            vmvalue = nunary->is_prefix ? VMValue::copy_value(--(*btv)) : VMValue::copy_value((*btv)--);
+
+        if(btv->is_input())
+            this->writeValue(btv, this->sizeOf(btv));
 
-    if(nunary->op == "--")
-        return nunary->is_prefix ? VMValue::copy_value(--(*btv)) : VMValue::copy_value((*btv)--);
+        return vmvalue;
+    }
 
     if(nunary->op == "!")
         return VMValue::copy_value(!(*btv));
@@ -247,8 +278,9 @@ VMValuePtr VM::interpret(NBinaryOperator *nbinary)
     if(!VMFunctions::is_type_compatible(lbtv, rbtv))
         return this->error("Cannot use '" + nbinary->op + "' operator with '" + lbtv->type_name() + "' and '" + rbtv->type_name() + "'");
     else if((nbinary->op == "=") && lbtv->is_const())
-        return this->error("Could not assign to constant variable '" + lbtv->value_id + "'");
+        return this->error("Could not assign to constant variable '" + this->symbolName(lbtv->value_id) + "'");
 
+    int64_t inputsize = (lbtv->is_input() && (lbtv->is_scalar() || lbtv->is_string())) ? this->sizeOf(lbtv) : -1; // Before strings are resized
     VMValuePtr btv;
 
     if(nbinary->op == "+")
@@ -298,6 +330,9 @@ VMValuePtr VM::interpret(NBinaryOperator *nbinary)
     else
         return this->error("Unknown binary operator '" + nbinary->op + "'");
 
+    if((inputsize != -1) && (btv.get() == lbtv.get()))
+        this->writeValue(btv, static_cast<uint64_t>(inputsize));
+
     return btv;
 }
 
@@ -327,9 +362,9 @@ VMValuePtr VM::interpret(NDotOperator *ndot)
     NIdentifier* nid = static_cast<NIdentifier*>(ndot->right);
 
     if(node_is_compound(vmvalue->value_typedef))
-        return (*vmvalue)[nid->value];
+        return vmvalue->is_member(nid->symbol);
 
-    return this->error("Cannot access '" + nid->value + "' from '" + vmvalue->value_id + "' of type '" + node_typename(vmvalue->value_typedef) + "'");
+    return this->error("Cannot access '" + nid->value + "' from '" + this->symbolName(vmvalue->value_id) + "' of type '" + node_typename(vmvalue->value_typedef) + "'");
 }
 
 VMValuePtr VM::interpret(NReturn *nreturn)
@@ -471,7 +506,7 @@ void VM::declare(Node *node)
     }
 
     VMScope& vmscope = CurrentScope();
-    vmscope.declarations[nid->value] = ntype;
+    vmscope.declarations[nid->symbol] = ntype;
 }
 
 void VM::declareVariables(NVariable *nvar)
@@ -492,7 +527,7 @@ void VM::declareVariables(NVariable *nvar)
 
 void VM::declareVariable(NVariable *nvar)
 {
-    VMValuePtr vmvar = VMValue::allocate(nvar->name->value);
+    VMValuePtr vmvar = VMValue::allocate(nvar->name->symbol);
     vmvar->value_typeid = VMFunctions::node_typeid(nvar->type);
 
     if(!this->_declarationstack.empty())
@@ -508,7 +543,7 @@ void VM::declareVariable(NVariable *nvar)
 
     if(it != scope.variables.end())
     {
-        this->error("Shadowing variable '" + vmvar->value_id + "'");
+        this->error("Shadowing variable '" + this->symbolName(vmvar->value_id) + "'");
         return;
     }
 
@@ -524,9 +559,23 @@ void VM::allocType(const VMValuePtr& vmvar, Node *node, Node *nsize, const NodeL
     {
         VMValuePtr vmsize = this->interpret(nsize);
 
+        if(this->state == VMState::Error)
+            return;
+
+        if(!vmsize) // Unsized, like TFindResults' arrays
+            vmsize = VMValue::allocate_literal(static_cast<int64_t>(0));
+
         if(!this->isSizeValid(vmsize))
             return;
 
+        if(!vmvar->is_const() && !vmvar->is_local())
+        {
+            int64_t elementsize = this->fixedSize(ndecl);
+
+            if(elementsize > 0) // The whole extent is known before reading the first element
+                this->prefetch(static_cast<uint64_t>(elementsize) * vmsize->ui_value);
+        }
+
         if(!node_is(ndecl, NCharType))
         {
             vmvar->allocate_array(vmsize->ui_value, ndecl);
@@ -593,6 +642,9 @@ void VM::allocType(const VMValuePtr& vmvar, Node *node, Node *nsize, const NodeL
 
 void VM::allocVariable(const VMValuePtr& vmvar, NVariable *nvar)
 {
+    bool istoplevel = !nvar->is_const && !nvar->is_local && this->_declarationstack.empty();
+    VMMemory::Attribution attribution(istoplevel ? vmvar->value_typeid : this->memory.attributing);
+
     if(nvar->bits)
         vmvar->value_bits = *this->interpret(nvar->bits)->value_ref<int64_t>();
 
@@ -627,7 +679,7 @@ void VM::allocVariable(const VMValuePtr& vmvar, NVariable *nvar)
 
         if(!VMFunctions::is_type_compatible(vmvar, vmvalue))
         {
-            this->error("'" + vmvar->value_id + "': cannot assign '" + vmvalue->type_name() + "' to '" + vmvar->type_name() + "'");
+            this->error("'" + this->symbolName(vmvar->value_id) + "': cannot assign '" + vmvalue->type_name() + "' to '" + vmvar->type_name() + "'");
             return;
         }
 
@@ -664,7 +716,7 @@ void VM::allocEnum(NEnum *nenum, std::function<void(const VMValuePtr &)> cb)
 
         vmenumval->value_flags |= VMValueFlags::Const;
         vmenumval->value_typedef = nenum->type;
-        vmenumval->value_id = nenumval->name->value;
+        vmenumval->value_id = nenumval->name->symbol;
         cb(vmenumval);
     }
 }
@@ -677,7 +729,7 @@ VMValuePtr VM::variable(NIdentifier *nid)
    {
        for(auto it = this->_declarationstack.rbegin(); it != this->_declarationstack.rend(); it++)
        {
-           vmvalue = (*it)->is_member(nid->value);
+           vmvalue = (*it)->is_member(nid->symbol);
 
            if(vmvalue)
                break;
@@ -686,7 +738,7 @@ VMValuePtr VM::variable(NIdentifier *nid)
 
    for(auto it = this->allocations.rbegin(); it != this->allocations.rend(); it++)
    {
-       if((*it)->value_id == nid->value)
+       if((*it)->value_id == nid->symbol)
        {
            vmvalue = *it;
            break;
@@ -696,7 +748,7 @@ VMValuePtr VM::variable(NIdentifier *nid)
    if(!vmvalue)
    {
        vmvalue = this->symbol<VMValuePtr>(nid, [](const VMScope& vmscope, NIdentifier* nid) -> VMValuePtr {
-           auto it = vmscope.variables.find(nid->value);
+           auto it = vmscope.variables.find(nid->symbol);
            return it != vmscope.variables.end() ? it->second : NULL;
        });
    }
@@ -707,6 +759,52 @@ VMValuePtr VM::variable(NIdentifier *nid)
     return vmvalue;
 }
 
+int64_t VM::fixedSize(Node *node)
+{
+    Node* ndecl = node_is(node, NType) ? this->declaration(node) : node;
+
+    if(!ndecl || node_is(ndecl, NStringType))
+        return -1;
+    else if(node_inherits(ndecl, NBasicType))
+        return static_cast<NBasicType*>(ndecl)->bits / PLATFORM_BITS;
+    else if(node_is(ndecl, NEnum))
+        return this->fixedSize(static_cast<NEnum*>(ndecl)->type);
+    else if(!node_is(ndecl, NStruct) && !node_is(ndecl, NUnion))
+        return -1;
+
+    int64_t size = 0;
+
+    for(Node* nmember : static_cast<NCompoundType*>(ndecl)->members)
+    {
+        if(!node_is(nmember, NVariable))
+            return -1; // Template logic, the layout depends on the data
+
+        NVariable* nvar = static_cast<NVariable*>(nmember);
+
+        if(nvar->is_const || nvar->is_local)
+            continue;
+
+        if(nvar->bits || !nvar->names.empty())
+            return -1;
+
+        Node* nsize = this->arraySize(nvar);
+        int64_t membersize = this->fixedSize(nvar->type);
+
+        while(node_is(nsize, NBlock) && (static_cast<NBlock*>(nsize)->statements.size() == 1))
+            nsize = static_cast<NBlock*>(nsize)->statements.front(); // Sizes are parsed as expression lists
+
+        if((membersize < 0) || (nsize && !node_is(nsize, NInteger)))
+            return -1;
+
+        if(nsize)
+            membersize *= static_cast<NInteger*>(nsize)->value;
+
+        size = node_is(ndecl, NUnion) ? std::max(size, membersize) : (size + membersize);
+    }
+
+    return size;
+}
+
 Node *VM::declaration(Node *node)
 {
     if(node_is(node, NType))
@@ -739,6 +837,9 @@ std::string VM::readFile(const string &file) const
 {
     FILE *fp = std::fopen(file.c_str(), "rb");
 
+    if(!fp)
+        throw std::runtime_error("Cannot open '" + file + "'");
+
     string s;
     std::fseek(fp, 0, SEEK_END);
 
@@ -751,6 +852,14 @@ std::string VM::readFile(const string &file) const
     return s;
 }
 
+VMValuePtr VM::currentDeclaration() const
+{
+    if(this->_declarationstack.empty())
+        return VMValuePtr();
+
+    return this->_declarationstack.back();
+}
+
 void VM::writeFile(const string &file, const string &data) const
 {
     FILE *fp = std::fopen(file.c_str(), "wb");
@@ -762,6 +871,12 @@ void VM::readValue(const VMValuePtr &vmvar, bool seek)
 {
     if(vmvar->is_array())
     {
+        if(seek && vmvar->m_value.size() && vmvar->m_value.front()->is_scalar())
+        {
+            this->readValues(vmvar->m_value, this->sizeOf(vmvar->m_value.front())); // Read at once
+            return;
+        }
+
         for(auto it = vmvar->m_value.begin(); it != vmvar->m_value.end(); it++)
             this->readValue(*it, seek);
     }
@@ -830,21 +945,22 @@ bool VM::pushScope(NIdentifier* nid, const NodeList& funcargs, const NodeList& c
             return false;
         }
 
-        vmarg->value_id = narg->name->value;
-        locals[narg->name->value] = vmarg;
+        vmarg->value_id = narg->name->symbol;
+        locals[narg->name->symbol] = vmarg;
     }
 
-    this->_scopestack.push_back(VMScope(locals));
+    this->_scopestack.push_back(VMScope(std::move(locals)));
     return true;
 }
 
-VM::VMCaseMap VM::buildCaseMap(NSwitch *nswitch)
+const VM::VMCaseMap& VM::buildCaseMap(NSwitch *nswitch)
 {
     auto it = this->_switchmap.find(nswitch);
 
     if(it != this->_switchmap.end())
         return it->second;
 
+    static const VMCaseMap nocases;
     uint64_t i = 0;
     VMCaseMap casemap;
 
@@ -853,7 +969,7 @@ VM::VMCaseMap VM::buildCaseMap(NSwitch *nswitch)
         if(!node_is(*it, NCase))
         {
             this->error("Expected NCase, got '" + node_typename(*it) + "'");
-            return VMCaseMap();
+            return nocases;
         }
 
         NCase* ncase = static_cast<NCase*>(*it);
@@ -867,8 +983,7 @@ VM::VMCaseMap VM::buildCaseMap(NSwitch *nswitch)
         casemap[*this->interpret(ncase->value)] = i++;
     }
 
-    this->_switchmap[nswitch] = casemap;
-    return casemap;
+    return this->_switchmap.emplace(nswitch, std::move(casemap)).first->second;
 }
 
 int64_t VM::getBits(const VMValuePtr &vmvalue)
@@ -920,7 +1035,7 @@ VMValuePtr VM::call(NCall *ncall)
 Node *VM::isDeclared(NIdentifier* nid) const
 {
     return this->symbol<Node*>(nid, [](const VMScope& vmscope, NIdentifier* nid) -> Node* {
-        auto it = vmscope.declarations.find(nid->value);
+        auto it = vmscope.declarations.find(nid->symbol);
         return it != vmscope.declarations.end() ? it->second : NULL;
     });
 }
@@ -1065,9 +1180,9 @@ int64_t VM::sizeOf(const VMValuePtr &vmvalue)
     if(node_is_compound(vmvalue->value_typedef))
     {
         if(node_is(vmvalue->value_typedef, NStruct))
-            return this->compoundSize(vmvalue->m_value);
+            return this->compoundSize(vmvalue->m_value.storage());
         else if(node_is(vmvalue->value_typedef, NUnion))
-            return this->unionSize(vmvalue->m_value);
+            return this->unionSize(vmvalue->m_value.storage());
 
         return this->sizeOf(vmvalue->value_typedef);
     }
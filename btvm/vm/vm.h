@@ -15,14 +15,14 @@ class VM
 {
     protected:
         typedef std::function<VMValuePtr(VM*, NCall*)> VMFunction;
-        typedef std::unordered_map<std::string, VMValuePtr> VMVariables;
-        typedef std::unordered_map<std::string, Node*> VMDeclarations;
+        typedef std::unordered_map<VMSymbol, VMValuePtr> VMVariables;
+        typedef std::unordered_map<VMSymbol, Node*> VMDeclarations;
         typedef std::unordered_map<std::string, VMFunction> VMFunctionsMap;
 
     private:
         struct VMScope {
             VMScope() { }
-            VMScope(VMVariables v): variables(v) { }
+            VMScope(VMVariables&& v): variables(std::move(v)) { }
 
             VMVariables variables;
             VMDeclarations declarations;
@@ -51,6 +51,9 @@ class VM
         VMValuePtr evaluate(const std::string& code);
         virtual void parse(const std::string& code);
         virtual uint32_t color(const std::string& color) const = 0;
+        const std::string& symbolName(VMSymbol symbol) const;
+        const VMMemoryStats& memoryStats() const;
+        void setMemoryAttribution(bool b);
         void dump(const std::string& file, const std::string& astfile);
         VMValuePtr interpret(Node* node);
         void loadAST(NBlock* _ast);
@@ -80,6 +83,7 @@ class VM
         void allocEnum(NEnum* nenum, std::function<void(const VMValuePtr&)> cb);
         VMValuePtr variable(NIdentifier* id);
         Node* arraySize(NVariable* nvar);
+        int64_t fixedSize(Node* node);
         Node* declaration(Node* node);
         Node* isDeclared(NIdentifier *nid) const;
         bool isLocal(Node* node) const;
@@ -87,7 +91,7 @@ class VM
         bool isSizeValid(const VMValuePtr& vmvalue);
         bool isVMFunction(NIdentifier* id) const;
         bool pushScope(NIdentifier *nid, const NodeList &funcargs, const NodeList &callargs);
-        VMCaseMap buildCaseMap(NSwitch* nswitch);
+        const VMCaseMap& buildCaseMap(NSwitch* nswitch);
         int64_t getBits(const VMValuePtr& vmvalue);
         int64_t getBits(Node *n);
         std::string readFile(const std::string& file) const;
@@ -108,6 +112,11 @@ class VM
         virtual uint32_t currentFgColor() const = 0;
         virtual uint32_t currentBgColor() const = 0;
         virtual void readValue(const VMValuePtr& vmvar, uint64_t size, bool seek) = 0;
+        virtual void readValues(const VMValueMembers& vmvalues, uint64_t size) = 0; // Scalar array elements
+        virtual void prefetch(uint64_t size) = 0; // Hint: 'size' bytes from the current offset are going to be read
+        virtual void writeValue(const VMValuePtr& vmvar, uint64_t size) = 0; // 'vmvar' has been assigned, queue it back to the input
+        virtual void commitValues() = 0; // Applies queued values once the template has run
+        VMValuePtr currentDeclaration() const; // Compound being declared, NULL at top level
         void declare(Node* node);
         int64_t sizeOf(const VMValuePtr& vmvalue);
         int64_t sizeOf(NIdentifier* nid);
@@ -116,8 +125,8 @@ class VM
 
     private:
         template<typename T> T symbol(NIdentifier* nid, std::function<T(const VMScope&, NIdentifier*)> cb) const;
-        template<typename T> int64_t unionSize(const std::vector<T> &v);
-        template<typename T> int64_t compoundSize(const std::vector<T> &v);
+        template<typename T, typename A> int64_t unionSize(const std::vector<T, A> &v);
+        template<typename T, typename A> int64_t compoundSize(const std::vector<T, A> &v);
         template<typename T> int64_t sizeOf(const std::vector<T> &v);
 
     private:
@@ -128,6 +137,8 @@ class VM
         NBlock* _ast;
 
     protected:
+        VMSymbolTable symbols;
+        VMMemoryStats memory;
         std::vector<VMValuePtr> allocations;
         VMFunctionsMap functions;
         int state;
@@ -150,7 +161,7 @@ template<typename T> T VM::symbol(NIdentifier *nid, std::function<T(const VMScop
     return cb(this->_globalscope, nid); // Try globals
 }
 
-template<typename T> int64_t VM::unionSize(const std::vector<T> &v)
+template<typename T, typename A> int64_t VM::unionSize(const std::vector<T, A> &v)
 {
     int64_t maxsize = 0;
 
@@ -160,7 +171,7 @@ template<typename T> int64_t VM::unionSize(const std::vector<T> &v)
     return maxsize;
 }
 
-template<typename T> int64_t VM::compoundSize(const std::vector<T> &v)
+template<typename T, typename A> int64_t VM::compoundSize(const std::vector<T, A> &v)
 {
     uint64_t totbits = 0, bftotsize = 0, boundarybits = 0;
 
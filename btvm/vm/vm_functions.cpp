@@ -1,6 +1,12 @@
 #include "vm_functions.h"
 #include <algorithm>
 #include <cstdint>
+#include <cstdio>
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <immintrin.h>
+    #define VM_SCAN_X86
+#endif
 
 namespace VMFunctions {
 
@@ -26,12 +32,26 @@ static VMValueType::VMType literal_type(NLiteral* nliteral)
     return VMValueType::Null;
 }
 
+size_t real_to_chars(char* buffer, double num) { return std::snprintf(buffer, REAL_BUFFER_SIZE, "%f", num); }
+
+void append_real(string &s, double num)
+{
+    char buffer[REAL_BUFFER_SIZE];
+    s.append(buffer, real_to_chars(buffer, num));
+}
+
 string format_string(const VMValuePtr& format, const ValueList& args)
 {
     string s;
+    format_string(s, format, args);
+    return s;
+}
+
+void format_string(string& s, const VMValuePtr& format, const ValueList& args)
+{
     int argidx = 0;
 
-    for(const char* p = format->s_value.data(); *p != '\0'; p++)
+    for(const char* p = format->s_value.storage().data(); *p != '\0'; p++)
     {
         if(*p != '%') // Eat words
         {
@@ -59,46 +79,30 @@ string format_string(const VMValuePtr& format, const ValueList& args)
 
         p++;
 
-        string sw;
-        double w = 0;
-
-        while((!w && (*p == '-')) || ((*p >= '0') && (*p <= '9')) || (*p == '.')) // Eat width, if any
-        {
-            sw += *p;
+        while((*p == '-') || ((*p >= '0') && (*p <= '9')) || (*p == '.')) // Eat width, if any
             p++;
-        }
-
-        if(!sw.empty())
-            w = atof(sw.c_str());
 
         switch(*p)
         {
             case 'd': // Signed integer
             case 'i': // Signed integer
-                s += std::to_string(get_arg(args, argidx)->si_value);
+                append_number(s, get_arg(args, argidx)->si_value, 10);
                 argidx++;
                 continue;
 
             case 'u': // Unsigned integer
-                s += std::to_string(get_arg(args, argidx)->ui_value);
+                append_number(s, get_arg(args, argidx)->ui_value, 10);
                 argidx++;
                 continue;
 
             case 'x': // Hex integer
             case 'X': // Hex integer
-            {
-                string c = number_to_string(get_arg(args, argidx)->ui_value, 16);
-
-                if(*p == 'X') // Uppercase...
-                    std::transform(c.begin(), c.end(), c.begin(), ::toupper);
-
-                s += c;
+                append_number(s, get_arg(args, argidx)->ui_value, 16, (*p == 'X'));
                 argidx++;
                 continue;
-            }
 
             case 'o': // Octal integer
-                s += number_to_string(get_arg(args, argidx)->ui_value, 8);
+                append_number(s, get_arg(args, argidx)->ui_value, 8);
                 argidx++;
                 continue;
 
@@ -108,14 +112,21 @@ string format_string(const VMValuePtr& format, const ValueList& args)
                 continue;
 
             case 's': // String
-                s += get_arg(args, argidx)->to_string();
+            {
+                size_t len = s.size();
+                get_arg(args, argidx)->printable(s);
+
+                if(s.size() == len)
+                    throw std::runtime_error("Trying to converting a '" + get_arg(args, argidx)->type_name() + "' to string");
+
                 argidx++;
                 continue;
+            }
 
             case 'f': // Float
             case 'e': // Float
             case 'g': // Float
-                s += std::to_string(get_arg(args, argidx)->d_value);
+                append_real(s, get_arg(args, argidx)->d_value);
                 argidx++;
                 continue;
 
@@ -125,7 +136,7 @@ string format_string(const VMValuePtr& format, const ValueList& args)
 
                 if(*p == 'f')
                 {
-                    s += std::to_string(get_arg(args, argidx)->d_value);
+                    append_real(s, get_arg(args, argidx)->d_value);
                     argidx++;
                     continue;
                 }
@@ -141,27 +152,20 @@ string format_string(const VMValuePtr& format, const ValueList& args)
                 switch(*p)
                 {
                     case 'd':
-                        s += std::to_string(get_arg(args, argidx)->si_value);
+                        append_number(s, get_arg(args, argidx)->si_value, 10);
                         argidx++;
                         continue;
 
                     case 'u':
-                        s += std::to_string(get_arg(args, argidx)->ui_value);
+                        append_number(s, get_arg(args, argidx)->ui_value, 10);
                         argidx++;
                         continue;
 
                     case 'x':
                     case 'X':
-                    {
-                        string c = number_to_string(get_arg(args, argidx)->ui_value, 16);
-
-                        if(*p == 'X') // Uppercase...
-                            std::transform(c.begin(), c.end(), c.begin(), ::toupper);
-
-                        s += c;
+                        append_number(s, get_arg(args, argidx)->ui_value, 16, (*p == 'X'));
                         argidx++;
                         continue;
-                    }
                 }
 
             }
@@ -172,8 +176,6 @@ string format_string(const VMValuePtr& format, const ValueList& args)
 
         s += *p;
     }
-
-    return s;
 }
 
 VMValueType::VMType integer_literal_type(uint64_t value)
@@ -263,21 +265,172 @@ bool type_cast(const VMValuePtr &vmvalue, Node* node)
                 vmvalue->d_value = static_cast<double>(vmvalue->ui_value);
         }
 
-        vmvalue->value_type = VMFunctions::value_type(node); // NOTE: Handle sign
+        vmvalue->change_type(VMFunctions::value_type(node)); // NOTE: Handle sign
         return true;
     }
 
     return false;
 }
 
-string node_typeid(Node *node)
+VMSymbol node_typeid(Node *node)
 {
     if(node_is(node, NIdentifier))
-        return static_cast<NIdentifier*>(node)->value;
+        return static_cast<NIdentifier*>(node)->symbol;
     else if(node_inherits(node, NType))
         return node_typeid(static_cast<NType*>(node)->name);
 
     throw std::runtime_error("Unhandled type '" + node_typename(node) + "'");
 }
 
+template<typename T> static const T* find_terminator_scalar(const T* begin, const T* end)
+{
+    while((begin < end) && *begin)
+        begin++;
+
+    return begin;
+}
+
+#ifdef VM_SCAN_X86
+template<typename T> __attribute__((target("sse2"))) static const T* find_terminator_sse2(const T* begin, const T* end)
+{
+    const __m128i zero = _mm_setzero_si128();
+    const size_t step = sizeof(__m128i) / sizeof(T);
+
+    for( ; static_cast<size_t>(end - begin) >= step; begin += step)
+    {
+        __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(begin));
+        int mask = _mm_movemask_epi8((sizeof(T) == 1) ? _mm_cmpeq_epi8(chunk, zero) : _mm_cmpeq_epi16(chunk, zero));
+
+        if(mask)
+            return begin + (__builtin_ctz(mask) / sizeof(T)); // One mask bit per byte
+    }
+
+    return find_terminator_scalar(begin, end);
+}
+
+template<typename T> __attribute__((target("avx2"))) static const T* find_terminator_avx2(const T* begin, const T* end)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    const size_t step = sizeof(__m256i) / sizeof(T);
+
+    for( ; static_cast<size_t>(end - begin) >= (step * 4); begin += step * 4) // Long strings: test 4 vectors at once
+    {
+        const __m256i* p = reinterpret_cast<const __m256i*>(begin);
+        __m256i c0 = _mm256_loadu_si256(p), c1 = _mm256_loadu_si256(p + 1), c2 = _mm256_loadu_si256(p + 2), c3 = _mm256_loadu_si256(p + 3);
+        __m256i m = (sizeof(T) == 1) ? _mm256_min_epu8(_mm256_min_epu8(c0, c1), _mm256_min_epu8(c2, c3)) :
+                                       _mm256_min_epu16(_mm256_min_epu16(c0, c1), _mm256_min_epu16(c2, c3));
+
+        if(_mm256_movemask_epi8((sizeof(T) == 1) ? _mm256_cmpeq_epi8(m, zero) : _mm256_cmpeq_epi16(m, zero)))
+            break; // Found, the loop below tells where
+    }
+
+    for( ; static_cast<size_t>(end - begin) >= step; begin += step)
+    {
+        __m256i chunk = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(begin));
+        uint32_t mask = static_cast<uint32_t>(_mm256_movemask_epi8((sizeof(T) == 1) ? _mm256_cmpeq_epi8(chunk, zero) : _mm256_cmpeq_epi16(chunk, zero)));
+
+        if(mask)
+            return begin + (__builtin_ctz(mask) / sizeof(T));
+    }
+
+    return find_terminator_sse2(begin, end);
+}
+#endif
+
+template<typename T> static const T* find_terminator_simd(const T* begin, const T* end)
+{
+#ifdef VM_SCAN_X86
+    static const bool avx2 = __builtin_cpu_supports("avx2"); // Checked once
+
+    if(avx2)
+        return find_terminator_avx2(begin, end);
+
+    return find_terminator_sse2(begin, end);
+#else
+    return find_terminator_scalar(begin, end);
+#endif
+}
+
+const char* find_terminator(const char* begin, const char* end) { return find_terminator_simd(begin, end); }
+const char16_t* find_terminator(const char16_t* begin, const char16_t* end) { return find_terminator_simd(begin, end); }
+
+template<typename T> static void swap_bytes_scalar(uint8_t* data, uint64_t count)
+{
+    for(uint64_t i = 0; i < count; i++, data += sizeof(T))
+    {
+        T v;
+        std::memcpy(&v, data, sizeof(T)); // Unaligned
+        v = byte_swap(v);
+        std::memcpy(data, &v, sizeof(T));
+    }
+}
+
+static void swap_bytes_scalar(uint8_t* data, uint64_t count, uint64_t width)
+{
+    if(width == sizeof(uint16_t))
+        swap_bytes_scalar<uint16_t>(data, count);
+    else if(width == sizeof(uint32_t))
+        swap_bytes_scalar<uint32_t>(data, count);
+    else
+        swap_bytes_scalar<uint64_t>(data, count);
+}
+
+#ifdef VM_SCAN_X86
+static const uint8_t* swap_bytes_mask(uint64_t width) // Byte order reversal of each value in a 16 bytes lane
+{
+    static const uint8_t masks[3][16] = { { 1, 0, 3, 2, 5, 4, 7, 6, 9, 8, 11, 10, 13, 12, 15, 14 },
+                                          { 3, 2, 1, 0, 7, 6, 5, 4, 11, 10, 9, 8, 15, 14, 13, 12 },
+                                          { 7, 6, 5, 4, 3, 2, 1, 0, 15, 14, 13, 12, 11, 10, 9, 8 } };
+
+    return masks[(width == sizeof(uint16_t)) ? 0 : ((width == sizeof(uint32_t)) ? 1 : 2)];
+}
+
+__attribute__((target("ssse3"))) static void swap_bytes_ssse3(uint8_t* data, uint64_t count, uint64_t width)
+{
+    const __m128i mask = _mm_loadu_si128(reinterpret_cast<const __m128i*>(swap_bytes_mask(width)));
+    uint64_t bytes = count * width;
+
+    for( ; bytes >= sizeof(__m128i); data += sizeof(__m128i), bytes -= sizeof(__m128i))
+    {
+        __m128i* p = reinterpret_cast<__m128i*>(data);
+        _mm_storeu_si128(p, _mm_shuffle_epi8(_mm_loadu_si128(p), mask));
+    }
+
+    swap_bytes_scalar(data, bytes / width, width);
+}
+
+__attribute__((target("avx2"))) static void swap_bytes_avx2(uint8_t* data, uint64_t count, uint64_t width)
+{
+    const __m256i mask = _mm256_broadcastsi128_si256(_mm_loadu_si128(reinterpret_cast<const __m128i*>(swap_bytes_mask(width)))); // Shuffles stay in their lane
+    uint64_t bytes = count * width;
+
+    for( ; bytes >= sizeof(__m256i); data += sizeof(__m256i), bytes -= sizeof(__m256i))
+    {
+        __m256i* p = reinterpret_cast<__m256i*>(data);
+        _mm256_storeu_si256(p, _mm256_shuffle_epi8(_mm256_loadu_si256(p), mask));
+    }
+
+    swap_bytes_ssse3(data, bytes / width, width);
+}
+#endif
+
+void swap_bytes(uint8_t* data, uint64_t count, uint64_t width)
+{
+    if((width != sizeof(uint16_t)) && (width != sizeof(uint32_t)) && (width != sizeof(uint64_t)))
+        return;
+
+#ifdef VM_SCAN_X86
+    static const bool avx2 = __builtin_cpu_supports("avx2"), ssse3 = __builtin_cpu_supports("ssse3");
+
+    if(avx2)
+        swap_bytes_avx2(data, count, width);
+    else if(ssse3)
+        swap_bytes_ssse3(data, count, width);
+    else
+        swap_bytes_scalar(data, count, width);
+#else
+    swap_bytes_scalar(data, count, width);
+#endif
+}
+
 }
@@ -1,6 +1,8 @@
 #ifndef BTVM_FUNCTIONS_H
 #define BTVM_FUNCTIONS_H
 
+#include <type_traits>
+#include <cstring>
 #include <string>
 #include <vector>
 #include "vmvalue.h"
@@ -8,6 +10,8 @@
 
 #define VMUnused(x) (void)x
 #define PLATFORM_BITS 8
+#define NUMBER_BUFFER_SIZE 66  // Sign + 64 binary digits + suffix
+#define REAL_BUFFER_SIZE   328 // "%f" of DBL_MAX
 
 enum VMState { NoState = 0,
                Error,
@@ -19,28 +23,53 @@ using namespace std;
 
 typedef vector<VMValuePtr> ValueList;
 
-template<typename T> string number_to_string(T num, int base)
+template<typename T> size_t number_to_chars(char* buffer, T num, int base, bool uppercase = false) // Needs NUMBER_BUFFER_SIZE bytes, 'uppercase' applies to the suffix
 {
-    static const char* digits = "0123456789abcdef";
-    string value;
+    typedef typename std::make_unsigned<T>::type UT;
 
-    do
+    static const char* digits = "0123456789ABCDEF";
+    char rbuffer[NUMBER_BUFFER_SIZE];
+    char* rend = rbuffer + NUMBER_BUFFER_SIZE;
+    char* p = rend;
+    UT unum = static_cast<UT>(num);
+    size_t len = 0;
+
+    if(num < static_cast<T>(0))
     {
-        value.insert(0, &digits[num % base], 1);
-        num /= base;
+        buffer[len++] = '-';
+        unum = static_cast<UT>(0) - unum;
     }
-    while(num != 0);
 
-    if(base == 16)
+    do
     {
-        std::transform(value.begin(), value.end(), value.begin(), ::toupper);
-        value += "h";
+        *--p = digits[unum % base];
+        unum /= base;
     }
+    while(unum != 0);
+
+    std::memcpy(buffer + len, p, rend - p);
+    len += rend - p;
+
+    if(base == 16)
+        buffer[len++] = uppercase ? 'H' : 'h';
     else if(base == 8)
-        value += "o";
+        buffer[len++] = 'o';
     else if(base == 2)
-        value += "b";
+        buffer[len++] = 'b';
 
+    return len;
+}
+
+template<typename T> void append_number(string& s, T num, int base, bool uppercase = false)
+{
+    char buffer[NUMBER_BUFFER_SIZE];
+    s.append(buffer, number_to_chars(buffer, num, base, uppercase));
+}
+
+template<typename T> string number_to_string(T num, int base)
+{
+    string value;
+    append_number(value, num, base);
     return value;
 }
 
@@ -59,14 +88,23 @@ inline int state_check(int* state)
 
 inline int64_t string_to_number(const string& s, int base) { return strtoul(s.c_str(), NULL, base); }
 inline double string_to_number(const string& s) { return atof(s.c_str()); }
+size_t real_to_chars(char* buffer, double num); // Needs REAL_BUFFER_SIZE bytes
+void append_real(string& s, double num);
+void format_string(string& s, const VMValuePtr &format, const ValueList& args);
 string format_string(const VMValuePtr &format, const ValueList& args);
-string node_typeid(Node* node);
+VMSymbol node_typeid(Node* node);
 VMValueType::VMType integer_literal_type(int64_t value);
 VMValueType::VMType scalar_type(uint64_t bits, bool issigned, bool isfp);
 VMValueType::VMType value_type(Node *node);
 bool is_type_compatible(const VMValuePtr& vmvalue1, const VMValuePtr& vmvalue2);
 bool type_cast(const VMValuePtr& vmvalue, Node *node);
 void change_sign(const VMValuePtr& vmvalue);
+const char* find_terminator(const char* begin, const char* end); // First NUL in [begin, end), 'end' if none
+const char16_t* find_terminator(const char16_t* begin, const char16_t* end);
+inline uint16_t byte_swap(uint16_t v) { return __builtin_bswap16(v); }
+inline uint32_t byte_swap(uint32_t v) { return __builtin_bswap32(v); }
+inline uint64_t byte_swap(uint64_t v) { return __builtin_bswap64(v); }
+void swap_bytes(uint8_t* data, uint64_t count, uint64_t width); // Reverses the byte order of 'count' values, 'width' is 2, 4 or 8
 
 }
 
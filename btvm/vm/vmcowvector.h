@@ -0,0 +1,95 @@
+#ifndef VMCOWVECTOR_H
+#define VMCOWVECTOR_H
+
+#include <vector>
+#include "vmmemory.h"
+#include "vmrefptr.h"
+
+/*
+ * Copy-on-write std::vector replacement used for VMValue's payloads:
+ * copies share the same storage until one of them is mutated.
+ * Read-only accessors never detach, so iteration only exposes const iterators.
+ * Copies are shallow: elements that are handles (VMValueMembers) still point
+ * to the same objects, writing through one of them doesn't detach anything.
+ * Storage is accounted under the given VMMemoryCategory and reference counted
+ * like VMValues: freeze() makes it safe to share with another thread.
+ */
+template<typename T, int Category> class VMCowVector
+{
+    public:
+        typedef VMMemory::Allocator<T, Category> Allocator;
+        typedef std::vector<T, Allocator> Storage;
+        typedef typename Storage::const_iterator const_iterator;
+        typedef typename Storage::size_type size_type;
+
+    public:
+        VMCowVector() { }
+        VMCowVector(const VMCowVector& rhs): _storage(rhs._storage) { }
+        VMCowVector(VMCowVector&& rhs): _storage(std::move(rhs._storage)) { }
+        VMCowVector& operator=(const VMCowVector& rhs) { _storage = rhs._storage; return *this; }
+        VMCowVector& operator=(VMCowVector&& rhs) { _storage = std::move(rhs._storage); return *this; }
+        void freeze() { if(_storage) _storage->freeze(); }
+
+    public: // Read-only access, shared storage is left untouched
+        const Storage& storage() const { return _storage ? _storage->storage : empty_storage(); }
+        operator const Storage&() const { return storage(); }
+        const_iterator begin() const { return storage().begin(); }
+        const_iterator end() const { return storage().end(); }
+        const_iterator cbegin() const { return storage().cbegin(); }
+        const_iterator cend() const { return storage().cend(); }
+        const T& operator[](size_type i) const { return _storage->storage[i]; }
+        const T& front() const { return _storage->storage.front(); }
+        const T& back() const { return _storage->storage.back(); }
+        const T* data() const { return storage().data(); }
+        size_type size() const { return _storage ? _storage->storage.size() : 0; }
+        size_type capacity() const { return _storage ? _storage->storage.capacity() : 0; }
+        bool empty() const { return !_storage || _storage->storage.empty(); }
+        bool shared() const { return _storage && (_storage->refcount() > 1); }
+
+    public: // Mutators, storage is detached first if shared
+        T* data() { return detach().data(); }
+        void push_back(const T& t) { detach().push_back(t); }
+        void push_back(T&& t) { detach().push_back(std::move(t)); }
+        void reserve(size_type n) { detach().reserve(n); }
+        void resize(size_type n, const T& t = T()) { detach().resize(n, t); }
+        template<typename It> void append(It first, It last) { Storage& s = detach(); s.insert(s.end(), first, last); }
+        void clear() { _storage.reset(); }
+
+    private:
+        struct Buffer: public VMRefCounted
+        {
+            Storage storage;
+
+            void freeze() { freeze_ref(); }
+            static void* operator new(size_t size) { void* p = ::operator new(size); VMMemory::allocated(Category, size); return p; }
+            static void operator delete(void* p, size_t size) { VMMemory::released(Category, size); ::operator delete(p); }
+        };
+
+    private:
+        Storage& detach();
+        static const Storage& empty_storage() { static const Storage storage; return storage; }
+
+    private:
+        VMRefPtr<Buffer> _storage;
+};
+
+template<typename T, int Category> typename VMCowVector<T, Category>::Storage& VMCowVector<T, Category>::detach()
+{
+    if(!_storage)
+        _storage = VMRefPtr<Buffer>(new Buffer());
+    else if(_storage->refcount() > 1)
+    {
+        VMRefPtr<Buffer> buffer(new Buffer());
+        buffer->storage.reserve(_storage->storage.capacity()); // Array sizes are tracked by capacity
+        buffer->storage.assign(_storage->storage.begin(), _storage->storage.end());
+
+        if(_storage->is_frozen())
+            buffer->freeze(); // The owner was frozen, other threads may copy it
+
+        _storage = std::move(buffer);
+    }
+
+    return _storage->storage;
+}
+
+#endif // VMCOWVECTOR_H
@@ -0,0 +1,34 @@
+#include "vmmemory.h"
+
+thread_local VMMemoryStats* VMMemory::current = NULL;
+
+void VMMemoryStats::reset()
+{
+    bool attribute = this->attribute;
+    *this = VMMemoryStats();
+    this->attribute = attribute;
+}
+
+VMMemory::Context::Context(VMMemoryStats *stats): _oldstats(VMMemory::current) { VMMemory::current = stats; }
+VMMemory::Context::~Context() { VMMemory::current = this->_oldstats; }
+
+VMMemory::Attribution::Attribution(VMSymbol symbol): _stats(VMMemory::current), _oldsymbol(SymbolNone)
+{
+    if(!this->_stats)
+        return;
+
+    this->_oldsymbol = this->_stats->attributing;
+    this->_stats->attributing = symbol;
+}
+
+VMMemory::Attribution::~Attribution()
+{
+    if(this->_stats)
+        this->_stats->attributing = this->_oldsymbol;
+}
+
+void VMMemory::attribute(VMMemoryStats *stats, int64_t bytes)
+{
+    if(stats->attributing != SymbolNone)
+        stats->attribution[stats->attributing] += bytes;
+}
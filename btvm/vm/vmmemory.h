@@ -0,0 +1,136 @@
+#ifndef VMMEMORY_H
+#define VMMEMORY_H
+
+#include <unordered_map>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include "vmsymbols.h"
+
+#define MemoryValueTypes 32 // Upper bound for VMValueType::VMType
+#define MemoryContext(x) VMMemory::Context __memory__(x)
+
+namespace VMMemoryCategory
+{
+    enum VMCategory { Values = 0, Members, Strings, Nodes, Entries, Last };
+}
+
+struct VMMemoryCounter
+{
+    VMMemoryCounter(): count(0), bytes(0), peak_count(0), peak_bytes(0) { }
+    void add(int64_t c, int64_t b) { count += c; bytes += b; if(count > peak_count) peak_count = count; if(bytes > peak_bytes) peak_bytes = bytes; }
+    void remove(int64_t c, int64_t b) { count -= c; bytes -= b; }
+
+    int64_t count;
+    int64_t bytes;
+    int64_t peak_count;
+    int64_t peak_bytes;
+};
+
+/*
+ * Live object counts and bytes of a VM execution, with their high-water marks.
+ * When attribution is enabled, every allocation is also charged to the type of
+ * the top-level template variable being declared at that time.
+ */
+struct VMMemoryStats
+{
+    VMMemoryStats(): attribute(false), attributing(SymbolNone) { }
+    void reset();
+
+    VMMemoryCounter total;
+    VMMemoryCounter categories[VMMemoryCategory::Last];
+    VMMemoryCounter values[MemoryValueTypes]; // VMValues by VMValueType
+    std::unordered_map<VMSymbol, int64_t> attribution; // Bytes allocated by top-level type
+    bool attribute;
+    VMSymbol attributing;
+};
+
+namespace VMMemory
+{
+    struct Context { // Makes stats the target of the accounting hooks
+        Context(VMMemoryStats* stats);
+        ~Context();
+
+        private:
+            VMMemoryStats* _oldstats;
+    };
+
+    struct Attribution { // Charges allocations to a top-level type
+        Attribution(VMSymbol symbol);
+        ~Attribution();
+
+        private:
+            VMMemoryStats* _stats;
+            VMSymbol _oldsymbol;
+    };
+
+    extern thread_local VMMemoryStats* current;
+
+    void attribute(VMMemoryStats* stats, int64_t bytes);
+
+    inline void allocated(int category, size_t bytes)
+    {
+        VMMemoryStats* stats = current;
+
+        if(!stats)
+            return;
+
+        stats->total.add(1, bytes);
+        stats->categories[category].add(1, bytes);
+
+        if(stats->attribute)
+            VMMemory::attribute(stats, bytes);
+    }
+
+    inline void released(int category, size_t bytes)
+    {
+        VMMemoryStats* stats = current;
+
+        if(!stats)
+            return;
+
+        stats->total.remove(1, bytes);
+        stats->categories[category].remove(1, bytes);
+    }
+
+    inline void value_allocated(int valuetype, size_t bytes)
+    {
+        VMMemory::allocated(VMMemoryCategory::Values, bytes);
+
+        if(current)
+            current->values[valuetype].add(1, bytes);
+    }
+
+    inline void value_released(int valuetype, size_t bytes)
+    {
+        VMMemory::released(VMMemoryCategory::Values, bytes);
+
+        if(current)
+            current->values[valuetype].remove(1, bytes);
+    }
+
+    inline void value_retyped(int oldtype, int newtype, size_t bytes)
+    {
+        if(!current || (oldtype == newtype))
+            return;
+
+        current->values[oldtype].remove(1, bytes);
+        current->values[newtype].add(1, bytes);
+    }
+
+    template<typename T, int Category> struct Allocator // Accounts container storage
+    {
+        typedef T value_type;
+        template<typename U> struct rebind { typedef Allocator<U, Category> other; };
+
+        Allocator() { }
+        template<typename U> Allocator(const Allocator<U, Category>&) { }
+
+        T* allocate(size_t n) { T* p = static_cast<T*>(::operator new(n * sizeof(T))); allocated(Category, n * sizeof(T)); return p; }
+        void deallocate(T* p, size_t n) { released(Category, n * sizeof(T)); ::operator delete(p); }
+        template<typename U> bool operator==(const Allocator<U, Category>&) const { return true; }
+        template<typename U> bool operator!=(const Allocator<U, Category>&) const { return false; }
+    };
+}
+
+#endif // VMMEMORY_H
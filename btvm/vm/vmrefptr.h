@@ -0,0 +1,82 @@
+#ifndef VMREFPTR_H
+#define VMREFPTR_H
+
+#include <cstddef>
+#include <cstdint>
+#include <atomic>
+
+/*
+ * Intrusive reference counting for VM objects.
+ * A VM never shares its values between threads, so counters are updated with
+ * plain loads and stores; freeze() switches an object to atomic updates before
+ * it is handed over to another thread.
+ */
+class VMRefCounted
+{
+    public:
+        VMRefCounted(): _refcount(0), _frozen(false) { }
+        VMRefCounted(const VMRefCounted&): _refcount(0), _frozen(false) { } // Copies start unowned
+        VMRefCounted& operator=(const VMRefCounted&) { return *this; }
+
+    public:
+        void ref() const
+        {
+            if(_frozen)
+                _refcount.fetch_add(1, std::memory_order_relaxed);
+            else
+                _refcount.store(_refcount.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        }
+
+        bool unref() const // Returns true when the last reference is gone
+        {
+            if(_frozen)
+                return _refcount.fetch_sub(1, std::memory_order_acq_rel) == 1;
+
+            uint32_t refcount = _refcount.load(std::memory_order_relaxed) - 1;
+            _refcount.store(refcount, std::memory_order_relaxed);
+            return !refcount;
+        }
+
+        uint32_t refcount() const { return _refcount.load(std::memory_order_relaxed); }
+        bool is_frozen() const { return _frozen; }
+
+    protected:
+        void freeze_ref() { _frozen = true; }
+
+    private:
+        mutable std::atomic<uint32_t> _refcount;
+        bool _frozen;
+};
+
+template<typename T> class VMRefPtr
+{
+    public:
+        VMRefPtr(): _ptr(NULL) { }
+        VMRefPtr(std::nullptr_t): _ptr(NULL) { }
+        explicit VMRefPtr(T* ptr): _ptr(ptr) { if(_ptr) _ptr->ref(); }
+        VMRefPtr(const VMRefPtr& rhs): _ptr(rhs._ptr) { if(_ptr) _ptr->ref(); }
+        VMRefPtr(VMRefPtr&& rhs): _ptr(rhs._ptr) { rhs._ptr = NULL; }
+        ~VMRefPtr() { release(); }
+
+        VMRefPtr& operator=(const VMRefPtr& rhs) { if(_ptr != rhs._ptr) VMRefPtr(rhs).swap(*this); return *this; } // Same object: no count updates
+        VMRefPtr& operator=(VMRefPtr&& rhs) { VMRefPtr(std::move(rhs)).swap(*this); return *this; }
+        VMRefPtr& operator=(std::nullptr_t) { reset(); return *this; }
+
+    public:
+        T* get() const { return _ptr; }
+        T* operator->() const { return _ptr; }
+        T& operator*() const { return *_ptr; }
+        explicit operator bool() const { return _ptr != NULL; }
+        bool operator==(const VMRefPtr& rhs) const { return _ptr == rhs._ptr; }
+        bool operator!=(const VMRefPtr& rhs) const { return _ptr != rhs._ptr; }
+        void swap(VMRefPtr& rhs) { T* ptr = _ptr; _ptr = rhs._ptr; rhs._ptr = ptr; }
+        void reset() { release(); _ptr = NULL; }
+
+    private:
+        void release() { if(_ptr && _ptr->unref()) delete _ptr; }
+
+    private:
+        T* _ptr;
+};
+
+#endif // VMREFPTR_H
@@ -0,0 +1,49 @@
+#include "vmsymbols.h"
+#include <stdexcept>
+
+thread_local VMSymbolTable* VMSymbolTable::_current = NULL;
+
+VMSymbolTable::VMSymbolTable()
+{
+    this->intern(std::string()); // SymbolNone
+}
+
+VMSymbol VMSymbolTable::intern(const std::string &name)
+{
+    auto it = this->_symbols.find(name);
+
+    if(it != this->_symbols.end())
+        return it->second;
+
+    VMSymbol symbol = static_cast<VMSymbol>(this->_names.size());
+    it = this->_symbols.emplace(name, symbol).first;
+    this->_names.push_back(&it->first); // Map nodes are stable, keys can be referenced
+    return symbol;
+}
+
+VMSymbol VMSymbolTable::lookup(const std::string &name) const
+{
+    auto it = this->_symbols.find(name);
+    return (it != this->_symbols.end()) ? it->second : SymbolNone;
+}
+
+const std::string &VMSymbolTable::name(VMSymbol symbol) const
+{
+    if(symbol >= this->_names.size())
+        throw std::runtime_error("Invalid symbol #" + std::to_string(symbol));
+
+    return *this->_names[symbol];
+}
+
+size_t VMSymbolTable::size() const
+{
+    return this->_names.size();
+}
+
+VMSymbolTable *VMSymbolTable::current()
+{
+    if(!VMSymbolTable::_current)
+        throw std::runtime_error("No symbol table is active");
+
+    return VMSymbolTable::_current;
+}
@@ -0,0 +1,41 @@
+#ifndef VMSYMBOLS_H
+#define VMSYMBOLS_H
+
+#include <unordered_map>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#define SymbolNone 0
+#define SymbolContext(x) VMSymbolTable::Context __symbols__(x)
+
+typedef uint32_t VMSymbol;
+
+class VMSymbolTable
+{
+    public:
+        struct Context { // Makes a table the target of NIdentifier interning
+            Context(VMSymbolTable* symbols): _oldsymbols(VMSymbolTable::_current) { VMSymbolTable::_current = symbols; }
+            ~Context() { VMSymbolTable::_current = this->_oldsymbols; }
+
+            private:
+                VMSymbolTable* _oldsymbols;
+        };
+
+    public:
+        VMSymbolTable();
+        VMSymbol intern(const std::string& name);
+        VMSymbol lookup(const std::string& name) const;
+        const std::string& name(VMSymbol symbol) const;
+        size_t size() const;
+
+    public:
+        static VMSymbolTable* current();
+
+    private:
+        std::unordered_map<std::string, VMSymbol> _symbols;
+        std::vector<const std::string*> _names;
+        static thread_local VMSymbolTable* _current;
+};
+
+#endif // VMSYMBOLS_H
@@ -2,6 +2,8 @@
 #include "vm_functions.h"
 #include <cstring>
 
+static_assert(VMValueType::Double < MemoryValueTypes, "VMMemoryStats cannot hold every VMValueType");
+
 #define return_math_op(op) \
     if(is_floating_point()) \
         return *value_ref<double>() op *rhs.value_ref<uint64_t>(); \
@@ -14,23 +16,58 @@
         return *value_ref<int64_t>() op *rhs.value_ref<int64_t>(); \
     return *value_ref<uint64_t>() op *rhs.value_ref<uint64_t>();
 
-VMValue::VMValue()               : value_flags(VMValueFlags::None), value_type(VMValueType::Null),   value_typedef(NULL), value_bgcolor(ColorInvalid), value_fgcolor(ColorInvalid), value_bits(-1), value_offset(0), s_value_ref(NULL), ui_value(0)     { }
-VMValue::VMValue(bool value)     : value_flags(VMValueFlags::None), value_type(VMValueType::Bool),   value_typedef(NULL), value_bgcolor(ColorInvalid), value_fgcolor(ColorInvalid), value_bits(-1), value_offset(0), s_value_ref(NULL), ui_value(value) { }
-VMValue::VMValue(int64_t value)  : value_flags(VMValueFlags::None), value_type(VMValueType::s64),    value_typedef(NULL), value_bgcolor(ColorInvalid), value_fgcolor(ColorInvalid), value_bits(-1), value_offset(0), s_value_ref(NULL), ui_value(value) { }
-VMValue::VMValue(uint64_t value) : value_flags(VMValueFlags::None), value_type(VMValueType::u64),    value_typedef(NULL), value_bgcolor(ColorInvalid), value_fgcolor(ColorInvalid), value_bits(-1), value_offset(0), s_value_ref(NULL), ui_value(value) { }
-VMValue::VMValue(double value)   : value_flags(VMValueFlags::None), value_type(VMValueType::Double), value_typedef(NULL), value_bgcolor(ColorInvalid), value_fgcolor(ColorInvalid), value_bits(-1), value_offset(0), s_value_ref(NULL), d_value(value)  { }
+VMValue::VMValue()               : value_flags(VMValueFlags::None), value_type(VMValueType::Null),   value_typedef(NULL), value_id(SymbolNone), value_typeid(SymbolNone), value_bgcolor(ColorInvalid), value_fgcolor(ColorInvalid), value_bits(-1), value_offset(0), s_value_ref(NULL), ui_value(0)     { VMMemory::value_allocated(value_type, sizeof(VMValue)); }
+VMValue::VMValue(bool value)     : value_flags(VMValueFlags::None), value_type(VMValueType::Bool),   value_typedef(NULL), value_id(SymbolNone), value_typeid(SymbolNone), value_bgcolor(ColorInvalid), value_fgcolor(ColorInvalid), value_bits(-1), value_offset(0), s_value_ref(NULL), ui_value(value) { VMMemory::value_allocated(value_type, sizeof(VMValue)); }
+VMValue::VMValue(int64_t value)  : value_flags(VMValueFlags::None), value_type(VMValueType::s64),    value_typedef(NULL), value_id(SymbolNone), value_typeid(SymbolNone), value_bgcolor(ColorInvalid), value_fgcolor(ColorInvalid), value_bits(-1), value_offset(0), s_value_ref(NULL), ui_value(value) { VMMemory::value_allocated(value_type, sizeof(VMValue)); }
+VMValue::VMValue(uint64_t value) : value_flags(VMValueFlags::None), value_type(VMValueType::u64),    value_typedef(NULL), value_id(SymbolNone), value_typeid(SymbolNone), value_bgcolor(ColorInvalid), value_fgcolor(ColorInvalid), value_bits(-1), value_offset(0), s_value_ref(NULL), ui_value(value) { VMMemory::value_allocated(value_type, sizeof(VMValue)); }
+VMValue::VMValue(double value)   : value_flags(VMValueFlags::None), value_type(VMValueType::Double), value_typedef(NULL), value_id(SymbolNone), value_typeid(SymbolNone), value_bgcolor(ColorInvalid), value_fgcolor(ColorInvalid), value_bits(-1), value_offset(0), s_value_ref(NULL), d_value(value)  { VMMemory::value_allocated(value_type, sizeof(VMValue)); }
+
+VMValue::VMValue(const VMValue &rhs): VMRefCounted(rhs), value_flags(rhs.value_flags), value_type(rhs.value_type), value_typedef(rhs.value_typedef), value_id(rhs.value_id), value_typeid(rhs.value_typeid),
+                                      value_comment(rhs.value_comment), value_bgcolor(rhs.value_bgcolor), value_fgcolor(rhs.value_fgcolor), value_bits(rhs.value_bits), value_offset(rhs.value_offset),
+                                      m_value(rhs.m_value), s_value(rhs.s_value), s_value_ref(rhs.s_value_ref), ui_value(rhs.ui_value)
+{
+    VMMemory::value_allocated(value_type, sizeof(VMValue));
+}
+
+VMValue::VMValue(VMValue &&rhs): VMRefCounted(rhs), value_flags(rhs.value_flags), value_type(rhs.value_type), value_typedef(rhs.value_typedef), value_id(rhs.value_id), value_typeid(rhs.value_typeid),
+                                 value_comment(std::move(rhs.value_comment)), value_bgcolor(rhs.value_bgcolor), value_fgcolor(rhs.value_fgcolor), value_bits(rhs.value_bits), value_offset(rhs.value_offset),
+                                 m_value(std::move(rhs.m_value)), s_value(std::move(rhs.s_value)), s_value_ref(rhs.s_value_ref), ui_value(rhs.ui_value)
+{
+    VMMemory::value_allocated(value_type, sizeof(VMValue));
+}
+
+VMValue::~VMValue() { VMMemory::value_released(value_type, sizeof(VMValue)); }
 
-VMValuePtr VMValue::allocate(const std::string &id)
+VMValue &VMValue::operator=(const VMValue &rhs)
 {
-    VMValuePtr vmvalue = std::make_shared<VMValue>();
+    change_type(rhs.value_type);
+    value_flags = rhs.value_flags;
+    value_typedef = rhs.value_typedef;
+    value_id = rhs.value_id;
+    value_typeid = rhs.value_typeid;
+    value_comment = rhs.value_comment;
+    value_bgcolor = rhs.value_bgcolor;
+    value_fgcolor = rhs.value_fgcolor;
+    value_bits = rhs.value_bits;
+    value_offset = rhs.value_offset;
+    m_value = rhs.m_value;
+    s_value = rhs.s_value;
+    s_value_ref = rhs.s_value_ref;
+    ui_value = rhs.ui_value;
+    return *this;
+}
+
+VMValuePtr VMValue::allocate(VMSymbol id)
+{
+    VMValuePtr vmvalue(new VMValue());
     vmvalue->value_id = id;
     return vmvalue;
 }
 
 VMValuePtr VMValue::allocate(VMValueType::VMType valuetype, Node *type)
 {
-    VMValuePtr vmvalue = std::make_shared<VMValue>();
-    vmvalue->value_type = valuetype;
+    VMValuePtr vmvalue(new VMValue());
+    vmvalue->change_type(valuetype);
     vmvalue->value_typedef = type;
     return vmvalue;
 }
@@ -75,7 +112,7 @@ VMValuePtr VMValue::allocate_literal(const std::string &value, Node *type)
 
 void VMValue::allocate_type(VMValueType::VMType valuetype, uint64_t size, Node *type)
 {
-    value_type = valuetype;
+    change_type(valuetype);
     value_typedef = type;
 
     if(size > 0)
@@ -97,29 +134,60 @@ void VMValue::allocate_string(uint64_t size, Node *type) { allocate_type(VMValue
 void VMValue::allocate_string(const std::string &s, Node *type)
 {
     allocate_string(s.size(), type);
-    std::copy(s.begin(), s.end(), s_value.begin());
+    std::copy(s.begin(), s.end(), s_value.data());
 }
 
-VMValuePtr VMValue::copy_value(const VMValue &vmsrc) { return std::make_shared<VMValue>(vmsrc); }
+VMValuePtr VMValue::copy_value(const VMValue &vmsrc)
+{
+    VMValuePtr vmvalue(new VMValue(vmsrc));
+    vmvalue->value_flags &= ~VMValueFlags::Input; // Copies don't alias the input
+    return vmvalue;
+}
+
+VMValuePtr VMValue::copy_value(VMValue &&vmsrc)
+{
+    VMValuePtr vmvalue(new VMValue(std::move(vmsrc)));
+    vmvalue->value_flags &= ~VMValueFlags::Input;
+    return vmvalue;
+}
+
+void VMValue::freeze()
+{
+    freeze_ref();
+    m_value.freeze();
+    s_value.freeze(); // Payloads are shared by copies too
+
+    for(auto it = m_value.begin(); it != m_value.end(); it++)
+    {
+        if(!(*it)->is_frozen())
+            (*it)->freeze();
+    }
+}
+
+void VMValue::change_type(VMValueType::VMType valuetype)
+{
+    VMMemory::value_retyped(value_type, valuetype, sizeof(VMValue));
+    value_type = valuetype;
+}
 
 void VMValue::change_sign()
 {
     if(value_type == VMValueType::u8)
-        value_type = VMValueType::s8;
+        change_type(VMValueType::s8);
     else if(value_type == VMValueType::u16)
-        value_type = VMValueType::s16;
+        change_type(VMValueType::s16);
     else if(value_type == VMValueType::u32)
-        value_type = VMValueType::s32;
+        change_type(VMValueType::s32);
     else if(value_type == VMValueType::u64)
-        value_type = VMValueType::s64;
+        change_type(VMValueType::s64);
     else if(value_type == VMValueType::s8)
-        value_type = VMValueType::u8;
+        change_type(VMValueType::u8);
     else if(value_type == VMValueType::s16)
-        value_type = VMValueType::u16;
+        change_type(VMValueType::u16);
     else if(value_type == VMValueType::s32)
-        value_type = VMValueType::u32;
+        change_type(VMValueType::u32);
     else if(value_type == VMValueType::s64)
-        value_type = VMValueType::u64;
+        change_type(VMValueType::u64);
 }
 
 void VMValue::assign(const VMValue &rhs)
@@ -133,26 +201,39 @@ void VMValue::assign(const VMValue &rhs)
         else
             *value_ref<uint64_t>() = rhs.ui_value;
     }
+    else if(is_struct() || is_union() || is_array())
+        m_value = rhs.m_value; // Member handles are shared, like copy_value() does
     else
     {
         if(is_reference())
             std::memcpy(s_value_ref, rhs.s_value.data(), rhs.s_value.size());
         else
-            s_value = rhs.s_value;
+            s_value = rhs.s_value; // Shared until either side is written
     }
 }
 
-VMValuePtr VMValue::create_reference(uint64_t offset, VMValueType::VMType valuetype) const
+void VMValue::assign(VMValue &&rhs)
 {
-    VMValuePtr vmvalue = std::make_shared<VMValue>();
+    if(is_scalar() || is_reference())
+        assign(static_cast<const VMValue&>(rhs));
+    else if(is_struct() || is_union() || is_array())
+        m_value = std::move(rhs.m_value);
+    else
+        s_value = std::move(rhs.s_value);
+}
+
+VMValuePtr VMValue::create_reference(uint64_t offset, VMValueType::VMType valuetype)
+{
+    VMValuePtr vmvalue(new VMValue());
     vmvalue->value_flags = value_flags | VMValueFlags::Reference;
-    vmvalue->value_type = (valuetype != VMValueType::Null) ? valuetype : value_type;
+    vmvalue->change_type((valuetype != VMValueType::Null) ? valuetype : value_type);
     vmvalue->value_typedef = value_typedef;
-    vmvalue->s_value_ref = const_cast<char*>(value_ref<char>()) + offset;
+    vmvalue->value_offset = value_offset + offset;
+    vmvalue->s_value_ref = value_ref<char>() + offset;
     return vmvalue;
 }
 
-VMValuePtr VMValue::is_member(const std::string &member) const
+VMValuePtr VMValue::is_member(VMSymbol member) const
 {
     for(auto it = m_value.begin(); it != m_value.end(); it++)
     {
@@ -167,6 +248,8 @@ bool VMValue::is_template() const  { return (!is_const() && !is_local()); }
 bool VMValue::is_const() const     { return (value_flags & VMValueFlags::Const); }
 bool VMValue::is_local() const     { return (value_flags & VMValueFlags::Local); }
 bool VMValue::is_reference() const { return (value_flags & VMValueFlags::Reference); }
+bool VMValue::is_input() const     { return (value_flags & VMValueFlags::Input); }
+bool VMValue::is_swapped() const   { return (value_flags & VMValueFlags::Swapped); }
 
 bool VMValue::is_readable() const       { return (value_type >= VMValueType::String) || (value_type == VMValueType::Enum); }
 bool VMValue::is_null() const           { return (value_type == VMValueType::Null); }
@@ -260,15 +343,25 @@ std::string VMValue::to_string() const
 }
 
 std::string VMValue::printable(int base) const
+{
+    std::string s;
+    printable(s, base);
+    return s;
+}
+
+void VMValue::printable(std::string &s, int base) const
 {
     if(is_integer())
-        return VMFunctions::number_to_string((is_signed() ? *value_ref<int64_t>() : *value_ref<uint64_t>()), base);
+    {
+        if(is_signed())
+            VMFunctions::append_number(s, *value_ref<int64_t>(), base);
+        else
+            VMFunctions::append_number(s, *value_ref<uint64_t>(), base);
+    }
     else if(is_floating_point())
-        return std::to_string(*value_ref<double>());
+        VMFunctions::append_real(s, *value_ref<double>());
     else if(is_string())
-        return value_ref<char>();
-
-    return std::string();
+        s += value_ref<char>();
 }
 
 int32_t VMValue::length() const
@@ -276,7 +369,11 @@ int32_t VMValue::length() const
     if(!is_string())
         return 0;
 
-    return std::strlen(value_ref<char>());
+    if(is_reference())
+        return std::strlen(value_ref<char>()); // Size is unknown
+
+    const char* s = s_value.data(); // Not terminated when reads hit EOF
+    return static_cast<int32_t>(VMFunctions::find_terminator(s, s + s_value.size()) - s);
 }
 
 VMValue::operator bool() const
@@ -375,8 +472,8 @@ VMValue VMValue::operator +(const VMValue& rhs) const
     {
         VMValue vmvalue;
         vmvalue.s_value.resize(s_value.size() + rhs.s_value.size());
-        vmvalue.s_value.insert(vmvalue.s_value.end(), s_value.begin(), s_value.end());
-        vmvalue.s_value.insert(vmvalue.s_value.end(), rhs.s_value.begin(), rhs.s_value.end());
+        vmvalue.s_value.append(s_value.begin(), s_value.end());
+        vmvalue.s_value.append(rhs.s_value.begin(), rhs.s_value.end());
         return vmvalue;
     }
 
@@ -394,21 +491,10 @@ VMValue VMValue::operator ^(const VMValue& rhs)  const { return *value_ref<uint6
 VMValue VMValue::operator <<(const VMValue& rhs) const { return *value_ref<uint64_t>() << *rhs.value_ref<uint64_t>(); }
 VMValue VMValue::operator >>(const VMValue& rhs) const { return *value_ref<uint64_t>() >> *rhs.value_ref<uint64_t>(); }
 
-VMValuePtr VMValue::operator[](const VMValue &index) const
+VMValuePtr VMValue::operator[](const VMValue &index)
 {
     if(is_string())
         return VMValue::create_reference(index.ui_value, VMValueType::s8);
 
     return m_value[index.ui_value];
 }
-
-VMValuePtr VMValue::operator[](const std::string &member) const
-{
-    for(auto it = m_value.cbegin(); it != m_value.cend(); it++)
-    {
-        if((*it)->value_id == member)
-            return *it;
-    }
-
-    return VMValuePtr();
-}
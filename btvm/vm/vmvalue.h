@@ -6,6 +6,9 @@
 #include <vector>
 #include <string>
 #include <map>
+#include "vmcowvector.h"
+#include "vmrefptr.h"
+#include "vmsymbols.h"
 
 #define ColorInvalid 0xFFFFFFFF
 
@@ -25,22 +28,26 @@ namespace VMValueType
 
 namespace VMValueFlags
 {
-    enum VMFlags { None = 0, Const = 1, Local = 2, Reference = 4 };
+    enum VMFlags { None = 0, Const = 1, Local = 2, Reference = 4, Input = 8, Swapped = 16 }; // Input: read from the input, assignments are written back (Swapped: in the other byte order)
 }
 
-typedef std::vector<char> VMString;
-typedef std::shared_ptr<VMValue> VMValuePtr;
-typedef std::vector<VMValuePtr> VMValueMembers;
+typedef VMCowVector<char, VMMemoryCategory::Strings> VMString;
+typedef VMRefPtr<VMValue> VMValuePtr;
+typedef VMCowVector<VMValuePtr, VMMemoryCategory::Members> VMValueMembers; // Copied compounds share their members, as they always did
 
-struct VMValue
+struct VMValue: public VMRefCounted
 {
     VMValue();
     VMValue(bool value);
     VMValue(int64_t value);
     VMValue(uint64_t value);
     VMValue(double value);
+    VMValue(const VMValue& rhs);
+    VMValue(VMValue&& rhs);
+    ~VMValue();
+    VMValue& operator=(const VMValue& rhs);
 
-    static VMValuePtr allocate(const std::string& id = std::string());
+    static VMValuePtr allocate(VMSymbol id = SymbolNone);
     static VMValuePtr allocate(VMValueType::VMType valuetype, Node* type = NULL);
     static VMValuePtr allocate(uint64_t bits, bool issigned, bool isfp, Node* type = NULL);
     static VMValuePtr allocate_literal(bool value, Node* type = NULL);
@@ -57,16 +64,22 @@ struct VMValue
     void allocate_string(const std::string& s, Node* type);
 
     static VMValuePtr copy_value(const VMValue &vmsrc);
+    static VMValuePtr copy_value(VMValue &&vmsrc);
 
+    void freeze();
+    void change_type(VMValueType::VMType valuetype);
     void change_sign();
     void assign(const VMValue& rhs);
-    VMValuePtr create_reference(uint64_t offset, VMValueType::VMType valuetype = VMValueType::Null) const;
-    VMValuePtr is_member(const std::string& member) const;
+    void assign(VMValue&& rhs);
+    VMValuePtr create_reference(uint64_t offset, VMValueType::VMType valuetype = VMValueType::Null);
+    VMValuePtr is_member(VMSymbol member) const;
 
     bool is_template() const;
     bool is_const() const;
     bool is_local() const;
     bool is_reference() const;
+    bool is_input() const;
+    bool is_swapped() const;
 
     bool is_readable() const;
     bool is_null() const;
@@ -86,6 +99,7 @@ struct VMValue
     std::string type_name() const;
     std::string to_string() const;
     std::string printable(int base = 10) const;
+    void printable(std::string& s, int base = 10) const;
     int32_t length() const;
 
     operator bool() const;
@@ -114,8 +128,7 @@ struct VMValue
     VMValue operator ^(const VMValue& rhs) const;
     VMValue operator <<(const VMValue& rhs) const;
     VMValue operator >>(const VMValue& rhs) const;
-    VMValuePtr operator[](const VMValue& index) const;
-    VMValuePtr operator[](const std::string& member) const;
+    VMValuePtr operator[](const VMValue& index);
 
     template<typename T> const T* value_ref() const;
     template<typename T> T* value_ref();
@@ -123,8 +136,8 @@ struct VMValue
     size_t               value_flags;
     VMValueType::VMType  value_type;
     Node*                value_typedef;
-    std::string          value_id;
-    std::string			 value_typeid;
+    VMSymbol             value_id;
+    VMSymbol             value_typeid;
     std::string			 value_comment;
     uint32_t 			 value_bgcolor;
     uint32_t 			 value_fgcolor;
@@ -165,7 +178,13 @@ template<typename T> const T* VMValue::value_ref() const
     return reinterpret_cast<const T*>((is_reference() ? s_value_ref : s_value.data()));
 }
 
-template<typename T> T* VMValue::value_ref() { return const_cast<T*>(static_cast<const VMValue*>(this)->value_ref<T>()); }
+template<typename T> T* VMValue::value_ref()
+{
+    if(is_integer() || is_enum() || is_floating_point() || is_reference())
+        return const_cast<T*>(static_cast<const VMValue*>(this)->value_ref<T>());
+
+    return reinterpret_cast<T*>(s_value.data()); // Detaches shared storage before writing
+}
 
 struct VMValueHasher
 {
@@ -0,0 +1,120 @@
+/*
+ * Checks that assignments to input-backed values are written back with the
+ * right encoding: runs a template over a writable copy of known bytes, commits,
+ * then compares the file with the expected bytes.
+ * Build: g++ -std=c++11 -pthread -I. tests/WriteBackTest.cpp $(find btvm -name '*.cpp') bt_lexer.cpp bt_parser.cpp -lz -o writebacktest
+ * Usage: writebacktest
+ */
+
+#include <iostream>
+#include <cstring>
+#include <cstdio>
+#include <vector>
+#include <string>
+#include "btvm/btvm.h"
+#include "btvm/io/mappedfileio.h"
+
+#define WRITEBACK_FILE "writebacktest.bin"
+
+struct TestCase
+{
+    const char* name;
+    const char* code;
+    std::vector<uint8_t> input;
+    std::vector<uint8_t> expected;
+};
+
+static bool writeFile(const std::vector<uint8_t>& data)
+{
+    FILE* fp = std::fopen(WRITEBACK_FILE, "wb");
+
+    if(!fp)
+        return false;
+
+    bool res = std::fwrite(data.data(), 1, data.size(), fp) == data.size();
+    std::fclose(fp);
+    return res;
+}
+
+static std::vector<uint8_t> readFile()
+{
+    std::vector<uint8_t> data;
+    FILE* fp = std::fopen(WRITEBACK_FILE, "rb");
+
+    if(!fp)
+        return data;
+
+    uint8_t buffer[256];
+    size_t count;
+
+    while((count = std::fread(buffer, 1, sizeof(buffer), fp)) > 0)
+        data.insert(data.end(), buffer, buffer + count);
+
+    std::fclose(fp);
+    return data;
+}
+
+static bool runTest(const TestCase& test)
+{
+    if(!writeFile(test.input))
+        return false;
+
+    MappedFileIO* btvmio = new MappedFileIO(WRITEBACK_FILE, true);
+    bool res;
+
+    {
+        BTVM btvm(btvmio);
+        btvm.evaluate(test.code); // Commits once the template has run
+        res = btvmio->commit();
+    }
+
+    delete btvmio;
+    return res && (readFile() == test.expected);
+}
+
+int main()
+{
+    const TestCase tests[] = {
+        { "Little endian float", "LittleEndian(); float f; f = 1.5;",
+          { 0x00, 0x00, 0x80, 0x40 }, { 0x00, 0x00, 0xC0, 0x3F } },
+
+        { "Big endian float", "BigEndian(); float f; f = 2.5;",
+          { 0x00, 0x00, 0x00, 0x00 }, { 0x40, 0x20, 0x00, 0x00 } },
+
+        { "Little endian double", "LittleEndian(); double d; d = 7.75;",
+          std::vector<uint8_t>(8, 0), { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x1F, 0x40 } },
+
+        { "Big endian double", "BigEndian(); double d; d = 7.75;",
+          std::vector<uint8_t>(8, 0), { 0x40, 0x1F, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 } },
+
+        { "Integers, byte order of the read", "LittleEndian(); uchar a; short b; uint c; BigEndian(); int64 d; a = 0xAB; b = -2; c++; d = 0x0102030405060708;",
+          { 0x00, 0x00, 0x00, 0x10, 0x00, 0x00, 0x00, 0, 0, 0, 0, 0, 0, 0, 0 },
+          { 0xAB, 0xFE, 0xFF, 0x11, 0x00, 0x00, 0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08 } },
+
+        { "Local copies are not written", "LittleEndian(); uint a; local uint b = a; b = 5;",
+          { 0x01, 0x00, 0x00, 0x00 }, { 0x01, 0x00, 0x00, 0x00 } },
+    };
+
+    int failed = 0;
+
+    for(const TestCase& test : tests)
+    {
+        bool ok;
+
+        try
+        {
+            ok = runTest(test);
+        }
+        catch(std::exception& e)
+        {
+            std::cout << e.what() << std::endl;
+            ok = false;
+        }
+
+        std::cout << test.name << "..." << (ok ? "OK" : "FAIL") << std::endl;
+        failed += !ok;
+    }
+
+    std::remove(WRITEBACK_FILE);
+    return failed ? 1 : 0;
+}
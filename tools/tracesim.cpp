@@ -0,0 +1,277 @@
+/*
+ * Replays access traces recorded with BTVMIO::setTrace() against different
+ * block cache and readahead settings, without parsing the input again.
+ * Build: g++ -std=c++11 -I. tools/tracesim.cpp btvm/io/accesstrace.cpp -o tracesim
+ * Usage: tracesim trace.bin [blocksize,blocks,readahead ...]
+ */
+
+#include <unordered_map>
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <cstdlib>
+#include <vector>
+#include <string>
+#include <list>
+#include <set>
+#include "btvm/io/accesstrace.h"
+
+#define SEQUENTIAL_STREAK 2 // Same policy as btvm/io/readahead.cpp
+
+struct Access
+{
+    AccessTrace::Kind kind;
+    uint64_t offset;
+    uint64_t length;
+};
+
+struct Settings
+{
+    uint64_t blocksize;
+    uint64_t blocks;
+    uint64_t readahead;
+};
+
+struct Results
+{
+    Results(): refills(0), cache_hits(0), cache_misses(0), readahead_hits(0), read_calls(0), read_bytes(0) { }
+
+    uint64_t refills;
+    uint64_t cache_hits;
+    uint64_t cache_misses;
+    uint64_t readahead_hits;
+    uint64_t read_calls;
+    uint64_t read_bytes;
+};
+
+/*
+ * Mirrors BTVMIO's window handling over an LRU block cache, only offsets are tracked.
+ * Readahead is modeled as if loads were instantaneous, so it is an upper bound.
+ */
+class Simulator
+{
+    public:
+        Simulator(const Settings& settings, uint64_t size): _settings(settings), _size(size), _position(0), _windowoffset(0), _windowsize(0), _windowlast(false), _nextoffset(UINT64_MAX), _streak(0) { }
+        const Results& results() const { return this->_results; }
+
+        void replay(const Access& access)
+        {
+            if(access.kind == AccessTrace::Raw)
+                this->fetch(access.offset, access.length);
+            else if(access.kind == AccessTrace::Seek)
+                this->seek(access.offset);
+            else
+                this->read(access.offset, access.length);
+        }
+
+    private:
+        bool inWindow(uint64_t offset) const
+        {
+            if(offset < this->_windowoffset)
+                return false;
+
+            uint64_t reloffset = offset - this->_windowoffset;
+            return (reloffset < this->_windowsize) || (this->_windowlast && (reloffset == this->_windowsize));
+        }
+
+        uint64_t fetch(uint64_t offset, uint64_t length)
+        {
+            uint64_t count = (offset < this->_size) ? std::min(length, this->_size - offset) : 0;
+
+            this->_results.read_calls++;
+            this->_results.read_bytes += count;
+            return count;
+        }
+
+        void seek(uint64_t offset)
+        {
+            this->_position = offset;
+
+            if(!this->inWindow(offset))
+                this->refill();
+        }
+
+        void read(uint64_t offset, uint64_t length)
+        {
+            this->_position = offset;
+
+            while(length)
+            {
+                if(this->inWindow(this->_position) && (this->_position < this->_windowoffset + this->_windowsize))
+                {
+                    uint64_t span = std::min(length, this->_windowoffset + this->_windowsize - this->_position);
+                    this->_position += span;
+                    length -= span;
+                }
+                else if(this->_windowlast && (this->_position >= this->_windowoffset + this->_windowsize))
+                    break; // EOF
+                else if(length < this->_settings.blocksize)
+                    this->refill();
+                else
+                {
+                    uint64_t count = this->fetch(this->_position, length); // Large reads bypass the cache
+
+                    this->_position += count;
+                    this->_windowoffset = this->_position;
+                    this->_windowsize = 0;
+                    this->_windowlast = count < length;
+                    length -= count;
+                }
+            }
+        }
+
+        void refill()
+        {
+            uint64_t blockoffset = this->_position - (this->_position % this->_settings.blocksize);
+            auto it = this->_index.find(blockoffset);
+
+            this->_results.refills++;
+
+            if(it != this->_index.end())
+            {
+                this->_results.cache_hits++;
+                this->_lru.splice(this->_lru.begin(), this->_lru, it->second);
+            }
+            else
+            {
+                this->_results.cache_misses++;
+
+                if(this->_prefetched.erase(blockoffset))
+                    this->_results.readahead_hits++;
+                else
+                    this->fetch(blockoffset, this->_settings.blocksize);
+
+                if(this->_lru.size() >= this->_settings.blocks)
+                {
+                    this->_index.erase(this->_lru.back());
+                    this->_lru.pop_back();
+                }
+
+                this->_lru.push_front(blockoffset);
+                this->_index[blockoffset] = this->_lru.begin();
+                this->access(blockoffset);
+            }
+
+            this->_windowoffset = blockoffset;
+            this->_windowsize = (blockoffset < this->_size) ? std::min(this->_settings.blocksize, this->_size - blockoffset) : 0;
+            this->_windowlast = this->_windowsize < this->_settings.blocksize;
+        }
+
+        void access(uint64_t blockoffset)
+        {
+            if(!this->_settings.readahead)
+                return;
+
+            uint64_t first = blockoffset + this->_settings.blocksize, last = blockoffset + (this->_settings.readahead * this->_settings.blocksize);
+            this->_streak = (blockoffset == this->_nextoffset) ? (this->_streak + 1) : 0;
+            this->_nextoffset = first;
+
+            if(!this->_streak) // Random access, what was loaded ahead is wasted
+                this->_prefetched.clear();
+            else
+            {
+                for(auto it = this->_prefetched.begin(); it != this->_prefetched.end(); )
+                    it = ((*it < first) || (*it > last)) ? this->_prefetched.erase(it) : std::next(it);
+            }
+
+            if(this->_streak + 1 < SEQUENTIAL_STREAK)
+                return;
+
+            for(uint64_t offset = first; (offset <= last) && (offset < this->_size) && (this->_prefetched.size() < this->_settings.readahead); offset += this->_settings.blocksize)
+            {
+                if(!this->_prefetched.count(offset) && !this->_index.count(offset) && this->_prefetched.insert(offset).second)
+                    this->fetch(offset, this->_settings.blocksize);
+            }
+        }
+
+    private:
+        std::unordered_map<uint64_t, std::list<uint64_t>::iterator> _index;
+        std::list<uint64_t> _lru; // Most recently used first
+        std::set<uint64_t> _prefetched;
+        Settings _settings;
+        Results _results;
+        uint64_t _size, _position;
+        uint64_t _windowoffset, _windowsize;
+        bool _windowlast;
+        uint64_t _nextoffset, _streak;
+};
+
+static bool parseSettings(const std::string& arg, Settings& settings)
+{
+    char* end = NULL;
+    settings.blocksize = std::strtoull(arg.c_str(), &end, 0);
+
+    if(*end != ',')
+        return false;
+
+    settings.blocks = std::strtoull(end + 1, &end, 0);
+
+    if(*end != ',')
+        return false;
+
+    settings.readahead = std::strtoull(end + 1, &end, 0);
+    return !*end && settings.blocksize && settings.blocks;
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " trace.bin [blocksize,blocks,readahead ...]" << std::endl;
+        return 1;
+    }
+
+    std::vector<Access> accesses;
+    std::vector<Settings> settings;
+    uint64_t size = 0;
+
+    if(!AccessTrace::replay(argv[1], size, [&accesses](AccessTrace::Kind kind, uint64_t offset, uint64_t length) { accesses.push_back({ kind, offset, length }); }))
+    {
+        std::cerr << "Cannot read trace '" << argv[1] << "'" << std::endl;
+        return 1;
+    }
+
+    for(int i = 2; i < argc; i++)
+    {
+        Settings s;
+
+        if(!parseSettings(argv[i], s))
+        {
+            std::cerr << "Invalid settings '" << argv[i] << "', expected blocksize,blocks,readahead" << std::endl;
+            return 1;
+        }
+
+        settings.push_back(s);
+    }
+
+    if(settings.empty()) // Default grid
+    {
+        for(uint64_t blocksize : { 4096u, 16384u, 65536u, 262144u })
+        {
+            for(uint64_t blocks : { 1u, 16u, 256u })
+            {
+                for(uint64_t readahead : { 0u, 8u })
+                    settings.push_back({ blocksize, blocks, readahead });
+            }
+        }
+    }
+
+    std::cout << accesses.size() << " accesses, input size " << size << std::endl;
+    std::cout << std::setw(10) << "blocksize" << std::setw(8) << "blocks" << std::setw(10) << "readahead" << std::setw(12) << "refills"
+              << std::setw(12) << "hits" << std::setw(12) << "misses" << std::setw(12) << "ra-hits" << std::setw(12) << "reads" << std::setw(16) << "bytes read" << std::endl;
+
+    for(const Settings& s : settings)
+    {
+        Simulator simulator(s, size);
+
+        for(const Access& access : accesses)
+            simulator.replay(access);
+
+        const Results& r = simulator.results();
+
+        std::cout << std::setw(10) << s.blocksize << std::setw(8) << s.blocks << std::setw(10) << s.readahead << std::setw(12) << r.refills
+                  << std::setw(12) << r.cache_hits << std::setw(12) << r.cache_misses << std::setw(12) << r.readahead_hits << std::setw(12) << r.read_calls << std::setw(16) << r.read_bytes << std::endl;
+    }
+
+    return 0;
+}
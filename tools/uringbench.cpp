@@ -0,0 +1,180 @@
+/*
+ * Compares URingFileIO with a buffered stdio BTVMIO on many small files,
+ * read by several threads at once (files per second, higher is better).
+ * Each file is opened, read at two offsets (or parsed with a template) and closed.
+ * "cold" passes drop the files from the page cache first with POSIX_FADV_DONTNEED.
+ * Build: g++ -std=c++11 -O2 -pthread -I. tools/uringbench.cpp $(find btvm -name '*.cpp') bt_lexer.cpp bt_parser.cpp -lz -o uringbench
+ * Usage: uringbench directory [files] [threads] [template.bt]
+ */
+
+#include <algorithm>
+#include <iostream>
+#include <iomanip>
+#include <stdexcept>
+#include <cstdlib>
+#include <cstdio>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include <string>
+#include <fcntl.h>
+#include <unistd.h>
+#include "btvm/btvm.h"
+#include "btvm/io/uringfileio.h"
+
+#define BENCH_FILE_SIZE 4096
+#define BENCH_FILES     20000
+#define BENCH_THREADS   16
+
+/*
+ * The default buffered path: stdio reads, no mapping.
+ */
+class BufferedFileIO: public BTVMIO
+{
+    public:
+        BufferedFileIO(const std::string& file): BTVMIO(), _size(0)
+        {
+            this->_fp = std::fopen(file.c_str(), "rb");
+
+            if(!this->_fp)
+                throw std::runtime_error("Cannot open '" + file + "'");
+
+            std::fseek(this->_fp, 0, SEEK_END);
+            this->_size = static_cast<uint64_t>(std::ftell(this->_fp));
+        }
+
+        ~BufferedFileIO() { this->setReadahead(0); std::fclose(this->_fp); }
+        virtual uint64_t size() const { return this->_size; }
+
+    protected:
+        virtual uint64_t readData(uint64_t offset, uint8_t* buffer, uint64_t size)
+        {
+            std::fseek(this->_fp, static_cast<long>(offset), SEEK_SET);
+            return std::fread(buffer, 1, size, this->_fp);
+        }
+
+    private:
+        FILE* _fp;
+        uint64_t _size;
+};
+
+static std::string fileName(const std::string& directory, size_t i) { return directory + "/bench" + std::to_string(i) + ".bin"; }
+
+static bool createFiles(const std::string& directory, size_t files)
+{
+    std::vector<uint8_t> data(BENCH_FILE_SIZE);
+
+    for(size_t i = 0; i < files; i++)
+    {
+        FILE* fp = std::fopen(fileName(directory, i).c_str(), "wb");
+
+        if(!fp)
+            return false;
+
+        for(size_t j = 0; j < data.size(); j++)
+            data[j] = static_cast<uint8_t>(i + j);
+
+        std::fwrite(data.data(), 1, data.size(), fp);
+        std::fclose(fp);
+    }
+
+    return true;
+}
+
+static void dropFiles(const std::string& directory, size_t files)
+{
+    for(size_t i = 0; i < files; i++)
+    {
+        int fd = open(fileName(directory, i).c_str(), O_RDONLY);
+
+        if(fd == -1)
+            continue;
+
+        posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+        close(fd);
+    }
+}
+
+template<typename IO> static void processFile(const std::string& file, const std::string& templatefile)
+{
+    IO btvmio(file);
+
+    if(!templatefile.empty())
+    {
+        BTVM btvm(&btvmio);
+        btvm.execute(templatefile);
+        return;
+    }
+
+    uint8_t buffer[16];
+    btvmio.readAt(0, buffer, sizeof(buffer));
+    btvmio.readAt(BENCH_FILE_SIZE / 2, buffer, sizeof(buffer));
+}
+
+template<typename IO> static double run(const std::string& directory, size_t files, size_t threads, const std::string& templatefile)
+{
+    std::vector<std::thread> workers;
+    auto start = std::chrono::steady_clock::now();
+
+    for(size_t t = 0; t < threads; t++)
+    {
+        workers.emplace_back([&, t]() {
+            for(size_t i = t; i < files; i += threads)
+                processFile<IO>(fileName(directory, i), templatefile);
+        });
+    }
+
+    for(std::thread& worker : workers)
+        worker.join();
+
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    return files / seconds;
+}
+
+int main(int argc, char** argv)
+{
+    if(argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " directory [files] [threads] [template.bt]" << std::endl;
+        return 1;
+    }
+
+    std::string directory = argv[1], templatefile = (argc > 4) ? argv[4] : std::string();
+    size_t files = (argc > 2) ? std::strtoull(argv[2], NULL, 0) : BENCH_FILES;
+    size_t maxthreads = (argc > 3) ? std::strtoull(argv[3], NULL, 0) : BENCH_THREADS;
+
+    if(!files || !maxthreads || !createFiles(directory, files))
+    {
+        std::cerr << "Cannot create " << files << " files in '" << directory << "'" << std::endl;
+        return 1;
+    }
+
+    std::cout << files << " files of " << BENCH_FILE_SIZE << " bytes, io_uring " << (URingQueue::shared()->available() ? "available" : "unavailable (syscall fallback)") << std::endl;
+    std::cout << std::setw(6) << "cache" << std::setw(9) << "threads" << std::setw(14) << "buffered/s" << std::setw(14) << "uring/s" << std::endl;
+
+    for(bool cold : { false, true })
+    {
+        for(size_t threads = 1; threads <= maxthreads; threads = (threads == maxthreads) ? threads + 1 : std::min(threads * 4, maxthreads))
+        {
+            if(cold)
+                dropFiles(directory, files);
+            else
+                run<BufferedFileIO>(directory, files, threads, templatefile); // Warm up
+
+            double buffered = run<BufferedFileIO>(directory, files, threads, templatefile);
+
+            if(cold)
+                dropFiles(directory, files);
+
+            double uring = run<URingFileIO>(directory, files, threads, templatefile);
+
+            std::cout << std::setw(6) << (cold ? "cold" : "warm") << std::setw(9) << threads << std::fixed << std::setprecision(0)
+                      << std::setw(14) << buffered << std::setw(14) << uring << std::endl;
+        }
+    }
+
+    for(size_t i = 0; i < files; i++)
+        std::remove(fileName(directory, i).c_str());
+
+    return 0;
+}